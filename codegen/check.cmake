@@ -0,0 +1,53 @@
+# Counts the instructions of every probe in the assembly listing ASM and fails when a probe `F`
+# takes more instructions than its raw-pointer counterpart `raw_F`.
+#
+# Usage: cmake -DASM=probes.s [-DSTAMP=ok.stamp] -P check.cmake
+
+if(NOT ASM)
+    message(FATAL_ERROR "ASM is not set")
+endif()
+
+file(STRINGS ${ASM} lines)
+
+set(functions)
+set(current)
+foreach(line IN LISTS lines)
+    if(line MATCHES "^([A-Za-z_][A-Za-z0-9_]*):$")
+        set(current ${CMAKE_MATCH_1})
+        list(APPEND functions ${current})
+        set(count_${current} 0)
+        set(listing_${current})
+    elseif(current AND line MATCHES "^[ \t]+\\.size[ \t]")
+        set(current)
+    elseif(current AND line MATCHES "^[ \t]+([a-z][^ \t]*)")
+        math(EXPR count_${current} "${count_${current}} + 1")
+        string(STRIP "${line}" instruction)
+        string(APPEND listing_${current} "    ${instruction}\n")
+    endif()
+endforeach()
+
+set(failures)
+set(checked 0)
+foreach(function IN LISTS functions)
+    if(function MATCHES "^raw_" OR NOT DEFINED count_raw_${function})
+        continue()
+    endif()
+    math(EXPR checked "${checked} + 1")
+    if(count_${function} GREATER count_raw_${function})
+        string(APPEND failures
+            "${function}: ${count_${function}} instructions, "
+            "raw_${function}: ${count_raw_${function}}\n"
+            "  ${function}:\n${listing_${function}}"
+            "  raw_${function}:\n${listing_raw_${function}}")
+    endif()
+endforeach()
+
+if(checked EQUAL 0)
+    message(FATAL_ERROR "No probes found in ${ASM}")
+endif()
+if(failures)
+    message(FATAL_ERROR "Smart pointers generate more code than raw pointers:\n${failures}")
+endif()
+if(STAMP)
+    file(WRITE ${STAMP} "${checked} probes\n")
+endif()
@@ -0,0 +1,145 @@
+// Probe functions for the codegen check (see check.cmake).
+// Every probe `F` is compiled at -O2 next to `raw_F`, the same operation written with plain
+// pointers, and must not take more instructions than it.
+
+#include <intrusive/intrusive.h>
+#include <unique/unique.h>
+
+#include <utility>
+
+struct Node : SimpleRefCounted<Node> {
+    int value;
+};
+
+struct RawNode {
+    size_t count;
+    int value;
+};
+
+namespace {
+
+void RawRelease(RawNode* node) {
+    if (node && --node->count == 0) {
+        delete node;
+    }
+}
+
+void RawAcquire(RawNode* node) {
+    if (node) {
+        ++node->count;
+    }
+}
+
+}  // namespace
+
+extern "C" {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// UniquePtr
+
+void unique_destroy(int* ptr) {
+    UniquePtr<int> owner(ptr);
+}
+
+void raw_unique_destroy(int* ptr) {
+    delete ptr;
+}
+
+void unique_destroy_null() {
+    UniquePtr<int> owner;
+}
+
+void raw_unique_destroy_null() {
+}
+
+bool unique_bool(const UniquePtr<int>& owner) {
+    return static_cast<bool>(owner);
+}
+
+bool raw_unique_bool(int* const& ptr) {
+    return ptr != nullptr;
+}
+
+void unique_move_construct(UniquePtr<int>& from, UniquePtr<int>* to) {
+    new (to) UniquePtr<int>(std::move(from));
+}
+
+void raw_unique_move_construct(int*& from, int** to) {
+    *to = std::exchange(from, nullptr);
+}
+
+void unique_move_assign(UniquePtr<int>& to, UniquePtr<int>& from) {
+    to = std::move(from);
+}
+
+void raw_unique_move_assign(int*& to, int*& from) {
+    int* old = to;
+    to = std::exchange(from, nullptr);
+    delete old;
+}
+
+void unique_reset(UniquePtr<int>& owner, int* ptr) {
+    owner.Reset(ptr);
+}
+
+void raw_unique_reset(int*& owner, int* ptr) {
+    int* old = owner;
+    owner = ptr;
+    delete old;
+}
+
+// The Itanium ABI passes a class with a non-trivial destructor through memory, so the fair
+// counterpart of a by-value UniquePtr parameter is a pointer read through a reference.
+int unique_by_value(UniquePtr<int> owner) {
+    return *owner;
+}
+
+int raw_unique_by_value(int* const& ptr) {
+    return *ptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// IntrusivePtr
+
+void intrusive_destroy(IntrusivePtr<Node>& owner) {
+    owner.~IntrusivePtr<Node>();
+}
+
+void raw_intrusive_destroy(RawNode*& owner) {
+    RawRelease(owner);
+}
+
+void intrusive_copy_construct(const IntrusivePtr<Node>& from, IntrusivePtr<Node>* to) {
+    new (to) IntrusivePtr<Node>(from);
+}
+
+void raw_intrusive_copy_construct(RawNode* const& from, RawNode** to) {
+    RawAcquire(from);
+    *to = from;
+}
+
+void intrusive_move_construct(IntrusivePtr<Node>& from, IntrusivePtr<Node>* to) {
+    new (to) IntrusivePtr<Node>(std::move(from));
+}
+
+void raw_intrusive_move_construct(RawNode*& from, RawNode** to) {
+    *to = std::exchange(from, nullptr);
+}
+
+void intrusive_reset(IntrusivePtr<Node>& owner) {
+    owner.Reset();
+}
+
+void raw_intrusive_reset(RawNode*& owner) {
+    RawRelease(std::exchange(owner, nullptr));
+}
+
+bool intrusive_bool(const IntrusivePtr<Node>& owner) {
+    return static_cast<bool>(owner);
+}
+
+bool raw_intrusive_bool(RawNode* const& ptr) {
+    return ptr != nullptr;
+}
+
+}  // extern "C"
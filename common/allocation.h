@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <new>  // std::align_val_t
+#include <type_traits>
+
+// Every smart pointer releases memory through `Deallocate`, passing the static size and alignment
+// of the object, so the allocator gets sized (and, when needed, aligned) frees.
+//
+// Build with -DSMART_PTR_FREE=MyFree to plug in a custom free function with the signature
+// `void MyFree(void* ptr, size_t size, size_t alignment)`. It receives memory obtained
+// from the global operator new (or from `Allocate` below). Objects that `DeleteObject` leaves to
+// a plain `delete` never reach it: polymorphic types that are not final (only the deleting
+// destructor knows their size) and types with a class-specific operator delete.
+
+inline void* Allocate(size_t size, size_t alignment) {
+    if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        return ::operator new(size, std::align_val_t{alignment});
+    }
+    return ::operator new(size);
+}
+
+inline void Deallocate(void* ptr, size_t size, size_t alignment) {
+#ifdef SMART_PTR_FREE
+    SMART_PTR_FREE(ptr, size, alignment);
+#else
+    if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        ::operator delete(ptr, size, std::align_val_t{alignment});
+    } else {
+        ::operator delete(ptr, size);
+    }
+#endif
+}
+
+template <typename T, typename = void>
+struct HasClassDelete : std::false_type {};
+
+template <typename T>
+struct HasClassDelete<T, std::void_t<decltype(T::operator delete(static_cast<void*>(nullptr)))>>
+    : std::true_type {};
+
+template <typename T, typename = void>
+struct HasSizedClassDelete : std::false_type {};
+
+template <typename T>
+struct HasSizedClassDelete<
+    T, std::void_t<decltype(T::operator delete(static_cast<void*>(nullptr), size_t{}))>>
+    : std::true_type {};
+
+// Destroys an object created by `new T`; like `delete`, does nothing for nullptr.
+// The static size is only trusted when it is the dynamic one: polymorphic non-final types go
+// through the deleting destructor (which passes the dynamic size itself), and types with their
+// own operator delete keep it.
+template <typename T>
+void DeleteObject(T* object) {
+    static_assert(sizeof(T) > 0);
+    static_assert(!std::is_void_v<T>);
+    if constexpr ((std::has_virtual_destructor_v<T> && !std::is_final_v<T>) ||
+                  HasClassDelete<T>::value || HasSizedClassDelete<T>::value) {
+        delete object;
+    } else if (object) {
+        using Object = std::remove_cv_t<T>;
+        auto* raw = const_cast<Object*>(object);
+        raw->~Object();
+        Deallocate(raw, sizeof(T), alignof(T));
+    }
+}
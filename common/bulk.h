@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>  // std::copy
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+
+// Bulk reference counting. Copying or releasing a range of pointers costs one count update per
+// element, and when many elements share a few objects those updates keep hitting the same
+// cache lines (or, with atomic counts, the same contended atomics). CopyAll and ReleaseAll
+// merge the updates per control block: a few batched `+k` and one `-k` respectively; an
+// object whose count reaches zero is released once, by the last adjustment.
+//
+// Merging pays off for atomic counts only. A plain increment of a count that is already in
+// cache costs no more than the lookup in the table of pending updates, so types with plain
+// counts are copied and released one element at a time.
+//
+// Pointer types take part by specializing BulkCounts next to their definition:
+//     static constexpr bool kCoalesce;      // false: element by element, the rest is unused
+//     using Key = ...;                      // what the counts live in
+//     static Key* KeyOf(const P& ptr);      // null for a null pointer
+//     static P CopyUncounted(const P& ptr); // a copy that takes over a reference added by Add
+//     static void Forget(P& ptr);           // drops the reference without counting it
+//     static void Add(Key* key, size_t n);
+//     static void Sub(Key* key, size_t n);
+
+template <typename P>
+struct BulkCounts;
+
+namespace bulk_detail {
+
+// Direct-mapped table of pending adjustments. With a skewed distribution the hot blocks stay
+// in their slots; a collision flushes the previous entry, so the result is always exact.
+//
+// Increments are taken ahead rather than after: a copy is counted before it is published, so
+// an output that throws (or that overwrites the source) only ever drops counted references.
+// A slot adds references in doubling batches and gives the unused ones back when it is
+// flushed, which keeps a hot block at O(log n) updates.
+template <typename P, bool kAdd>
+class Coalescer {
+    using Counts = BulkCounts<P>;
+    using Key = typename Counts::Key;
+
+public:
+    Coalescer() = default;
+
+    Coalescer(const Coalescer&) = delete;
+    Coalescer& operator=(const Coalescer&) = delete;
+
+    ~Coalescer() {
+        for (Slot& slot : slots_) {
+            Apply(slot);
+        }
+    }
+
+    // With kAdd, takes one of the references reserved for `key`; otherwise defers one release
+    void Push(Key* key) {
+        Slot& slot = slots_[Hash(key)];
+        if (slot.key != key) {
+            Apply(slot);
+            slot.key = key;
+            slot.batch = 0;
+        }
+        if constexpr (kAdd) {
+            if (slot.count == 0) {
+                slot.batch = slot.batch == 0 ? 1 : 2 * slot.batch;
+                Counts::Add(key, slot.batch);
+                slot.count = slot.batch;
+            }
+            --slot.count;
+        } else {
+            ++slot.count;
+        }
+    }
+
+private:
+    static constexpr size_t kSlotBits = 8;
+
+    struct Slot {
+        Key* key = nullptr;
+        size_t count = 0;  // reserved and unused with kAdd, pending releases otherwise
+        size_t batch = 0;
+    };
+
+    static size_t Hash(const Key* key) {
+        auto bits = reinterpret_cast<uintptr_t>(key) >> 4;
+        return (bits * 0x9e3779b97f4a7c15) >> (64 - kSlotBits);
+    }
+
+    // Either way the slot holds references that nobody owns any more
+    static void Apply(Slot& slot) {
+        if (slot.key && slot.count != 0) {
+            Counts::Sub(slot.key, slot.count);
+        }
+        slot.key = nullptr;
+        slot.count = 0;
+    }
+
+    Slot slots_[size_t{1} << kSlotBits];
+};
+
+}  // namespace bulk_detail
+
+// Writes copies of the pointers in `src` to `dst`; returns the end of the output
+template <typename Range, typename OutputIt>
+OutputIt CopyAll(const Range& src, OutputIt dst) {
+    using P = std::remove_cv_t<std::remove_reference_t<decltype(*std::begin(src))>>;
+    using Counts = BulkCounts<P>;
+
+    if constexpr (Counts::kCoalesce) {
+        bulk_detail::Coalescer<P, true> increments;
+        for (const P& ptr : src) {
+            if (auto* key = Counts::KeyOf(ptr)) {
+                increments.Push(key);
+            }
+            *dst = Counts::CopyUncounted(ptr);
+            ++dst;
+        }
+        return dst;
+    } else {
+        return std::copy(std::begin(src), std::end(src), dst);
+    }
+}
+
+// Resets every pointer in `range`
+template <typename Range>
+void ReleaseAll(Range&& range) {
+    using P = std::remove_reference_t<decltype(*std::begin(range))>;
+    using Counts = BulkCounts<P>;
+
+    if constexpr (Counts::kCoalesce) {
+        bulk_detail::Coalescer<P, false> decrements;
+        for (P& ptr : range) {
+            if (auto* key = Counts::KeyOf(ptr)) {
+                decrements.Push(key);
+                Counts::Forget(ptr);
+            }
+        }
+    } else {
+        for (P& ptr : range) {
+            ptr.Reset();
+        }
+    }
+}
@@ -0,0 +1,317 @@
+#pragma once
+
+#include "epoch.h"
+#include "reclaim.h"
+#include "shared_core.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>  // std::hash / std::equal_to
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Concurrent map from keys to `BasicSharedPtr<const V>` for read-mostly data.
+//
+// Readers take no lock and write nothing shared: under an EpochGuard, `Find` walks the bucket
+// chain and returns a BorrowedPtr to the value without touching its reference count. The
+// borrowed pointer stays valid until the guard is gone, and `Lock()` turns it into an owning
+// pointer when the value has to outlive the guard.
+//
+// Writers lock one shard. A replaced or erased entry is unlinked and retired to the
+// EpochReclaimer, so its value is released only after every reader that could have seen it has
+// dropped its guard. Growing a shard copies its entries into a new table and retires the old
+// one, so a reader never sees a chain being rewired.
+
+template <typename T, typename Policy>
+class BorrowedPtr {
+public:
+    BorrowedPtr() = default;
+
+    explicit BorrowedPtr(const BasicSharedPtr<T, Policy>& owner)
+        : ptr_(owner.Get()), block_(owner.GetBlock()) {
+    }
+
+    // An owning pointer to the same object. The owner it was borrowed from is alive as long as
+    // the guard is, so the count cannot be zero here.
+    BasicSharedPtr<T, Policy> Lock() const {
+        if (!block_) {
+            return BasicSharedPtr<T, Policy>();
+        }
+        block_->StrongInc();
+        return BasicSharedPtr<T, Policy>(ptr_, block_);
+    }
+
+    T* Get() const {
+        return ptr_;
+    }
+
+    T& operator*() const {
+        return *ptr_;
+    }
+
+    T* operator->() const {
+        return ptr_;
+    }
+
+    explicit operator bool() const {
+        return ptr_ != nullptr;
+    }
+
+private:
+    T* ptr_ = nullptr;
+    SharedBlock<Policy>* block_ = nullptr;
+};
+
+template <typename K, typename V, typename Policy, typename Hash = std::hash<K>,
+          typename KeyEqual = std::equal_to<K>>
+class ConcurrentMap {
+    static_assert(std::is_same_v<typename Policy::CountType, AtomicCount>,
+                  "values shared between threads need AtomicCount");
+
+public:
+    using Value = BasicSharedPtr<const V, Policy>;
+    using Borrowed = BorrowedPtr<const V, Policy>;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    // `shards` is rounded up to a power of two; every shard has a lock for writers
+    explicit ConcurrentMap(size_t shards = 64, const Hash& hash = Hash(),
+                           const KeyEqual& equal = KeyEqual())
+        : shards_(RoundUp(shards)), hash_(hash), equal_(equal) {
+        for (Shard& shard : shards_) {
+            shard.table.store(new Table(kInitialBuckets), std::memory_order_relaxed);
+        }
+    }
+
+    ConcurrentMap(const ConcurrentMap&) = delete;
+    ConcurrentMap& operator=(const ConcurrentMap&) = delete;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    // No reader may be left; what was retired earlier is independent of the map
+    ~ConcurrentMap() {
+        for (Shard& shard : shards_) {
+            DeleteTable(shard.table.load(std::memory_order_relaxed));
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Writers
+
+    // Returns false (and leaves the map unchanged) if `key` is present
+    bool Insert(const K& key, Value value) {
+        return Store(key, std::move(value), false);
+    }
+
+    // Returns true if `key` was not present
+    bool InsertOrAssign(const K& key, Value value) {
+        return Store(key, std::move(value), true);
+    }
+
+    bool Erase(const K& key) {
+        size_t hash = Mix(hash_(key));
+        Shard& shard = ShardOf(hash);
+        Node* erased;
+        {
+            std::lock_guard lock(shard.mutex);
+            Table* table = shard.table.load(std::memory_order_relaxed);
+            std::atomic<Node*>* link = FindLink(table, hash, key);
+            erased = link->load(std::memory_order_relaxed);
+            if (!erased) {
+                return false;
+            }
+            link->store(erased->next.load(std::memory_order_relaxed), std::memory_order_release);
+            shard.size.store(shard.size.load(std::memory_order_relaxed) - 1,
+                             std::memory_order_relaxed);
+        }
+        EpochReclaimer::Retire(PendingRelease::Of<Node, &DeleteNode>(erased));
+        return true;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Readers
+
+    // The value of `key` (null if there is none), valid while `guard` lives
+    Borrowed Find(const K& key, const EpochGuard& guard) const {
+        (void)guard;
+        size_t hash = Mix(hash_(key));
+        const Table* table = ShardOf(hash).table.load(std::memory_order_acquire);
+        for (Node* node = table->Bucket(hash).load(std::memory_order_acquire); node;
+             node = node->next.load(std::memory_order_acquire)) {
+            if (node->hash == hash && equal_(node->key, key)) {
+                return Borrowed(node->value);
+            }
+        }
+        return Borrowed();
+    }
+
+    // Calls `f(const V&)` on the value of `key`; returns false if there is none
+    template <typename F>
+    bool Visit(const K& key, F&& f) const {
+        EpochGuard guard;
+        Borrowed value = Find(key, guard);
+        if (!value) {
+            return false;
+        }
+        f(*value);
+        return true;
+    }
+
+    // An owning pointer to the value of `key`, null if there is none
+    Value Get(const K& key) const {
+        EpochGuard guard;
+        return Find(key, guard).Lock();
+    }
+
+    // Exact when no writer is running
+    size_t Size() const {
+        size_t size = 0;
+        for (const Shard& shard : shards_) {
+            size += shard.size.load(std::memory_order_relaxed);
+        }
+        return size;
+    }
+
+private:
+    static constexpr size_t kInitialBuckets = 8;
+
+    struct Node {
+        const K key;
+        const size_t hash;
+        const Value value;
+        std::atomic<Node*> next;
+    };
+
+    struct Table {
+        explicit Table(size_t buckets) : buckets(buckets) {
+        }
+
+        std::atomic<Node*>& Bucket(size_t hash) {
+            return buckets[hash & (buckets.size() - 1)];
+        }
+
+        const std::atomic<Node*>& Bucket(size_t hash) const {
+            return buckets[hash & (buckets.size() - 1)];
+        }
+
+        std::vector<std::atomic<Node*>> buckets;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::atomic<Table*> table = nullptr;
+        // Written under the mutex only
+        std::atomic<size_t> size = 0;
+    };
+
+    static size_t RoundUp(size_t count) {
+        size_t result = 1;
+        while (result < count) {
+            result *= 2;
+        }
+        return result;
+    }
+
+    // Spreads sequential keys (std::hash of integers is the identity) over shards and buckets
+    static size_t Mix(size_t hash) {
+        return static_cast<size_t>(static_cast<uint64_t>(hash) * 0x9e3779b97f4a7c15);
+    }
+
+    Shard& ShardOf(size_t hash) {
+        return shards_[(hash >> 32) & (shards_.size() - 1)];
+    }
+
+    const Shard& ShardOf(size_t hash) const {
+        return shards_[(hash >> 32) & (shards_.size() - 1)];
+    }
+
+    // The link that points to the node of `key`, or the null link at the end of its chain.
+    // Writers only.
+    std::atomic<Node*>* FindLink(Table* table, size_t hash, const K& key) {
+        std::atomic<Node*>* link = &table->Bucket(hash);
+        while (Node* node = link->load(std::memory_order_relaxed)) {
+            if (node->hash == hash && equal_(node->key, key)) {
+                break;
+            }
+            link = &node->next;
+        }
+        return link;
+    }
+
+    bool Store(const K& key, Value&& value, bool overwrite) {
+        size_t hash = Mix(hash_(key));
+        Shard& shard = ShardOf(hash);
+        PendingRelease retired{nullptr, nullptr};
+        bool inserted;
+        {
+            std::lock_guard lock(shard.mutex);
+            Table* table = shard.table.load(std::memory_order_relaxed);
+            std::atomic<Node*>* link = FindLink(table, hash, key);
+            if (Node* old = link->load(std::memory_order_relaxed)) {
+                if (!overwrite) {
+                    return false;
+                }
+                Node* next = old->next.load(std::memory_order_relaxed);
+                link->store(new Node{key, hash, std::move(value), next},
+                            std::memory_order_release);
+                retired = PendingRelease::Of<Node, &DeleteNode>(old);
+                inserted = false;
+            } else {
+                std::atomic<Node*>& bucket = table->Bucket(hash);
+                Node* head = bucket.load(std::memory_order_relaxed);
+                bucket.store(new Node{key, hash, std::move(value), head},
+                             std::memory_order_release);
+                size_t size = shard.size.load(std::memory_order_relaxed) + 1;
+                shard.size.store(size, std::memory_order_relaxed);
+                if (size > table->buckets.size()) {
+                    retired = Grow(shard, *table);
+                }
+                inserted = true;
+            }
+        }
+        // Outside the lock: releasing the old value may run any destructor
+        if (retired.object) {
+            EpochReclaimer::Retire(retired);
+        }
+        return inserted;
+    }
+
+    // Publishes a copy of `table` with twice the buckets; returns the old one for retirement
+    static PendingRelease Grow(Shard& shard, Table& table) {
+        auto* grown = new Table(table.buckets.size() * 2);
+        for (const std::atomic<Node*>& bucket : table.buckets) {
+            for (Node* node = bucket.load(std::memory_order_relaxed); node;
+                 node = node->next.load(std::memory_order_relaxed)) {
+                std::atomic<Node*>& target = grown->Bucket(node->hash);
+                Node* head = target.load(std::memory_order_relaxed);
+                target.store(new Node{node->key, node->hash, node->value, head},
+                             std::memory_order_relaxed);
+            }
+        }
+        shard.table.store(grown, std::memory_order_release);
+        return PendingRelease::Of<Table, &DeleteTable>(&table);
+    }
+
+    static void DeleteNode(Node* node) {
+        delete node;
+    }
+
+    static void DeleteTable(Table* table) {
+        for (std::atomic<Node*>& bucket : table->buckets) {
+            Node* node = bucket.load(std::memory_order_relaxed);
+            while (node) {
+                delete std::exchange(node, node->next.load(std::memory_order_relaxed));
+            }
+        }
+        delete table;
+    }
+
+    std::vector<Shard> shards_;
+    [[no_unique_address]] Hash hash_;
+    [[no_unique_address]] KeyEqual equal_;
+};
@@ -0,0 +1,283 @@
+#pragma once
+
+#include "shared_fwd.h"
+
+#include <cassert>
+#include <cstddef>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Opt-in collection of reference cycles, by trial deletion as in CPython's gc.
+//
+// A type takes part by defining `void Traverse(GcVisitor& visitor)` that calls
+// `visitor.Visit(field)` for every SharedPtr it holds. When a strong reference to such an
+// object goes away and others are left, its block becomes a candidate. `Collect()` looks at
+// everything reachable from the candidates, subtracts the references they hold to each other and
+// frees whatever is left without outside references.
+//
+// Other types are not affected: their blocks are never tracked and releasing them costs the same.
+// The collector is per thread, so configurations with atomic counts do not take part.
+// A candidate belongs to the collector of the thread that last tracked it, and forgets it when
+// the block is destroyed on any thread. Plain counts may still be handed between threads with
+// outside synchronization, but `Collect()` reads its candidates, so it must not run while
+// another thread uses objects this thread released references to.
+// Cycles are found through the static type of the releasing SharedPtr: an object only ever
+// released through a pointer to a base without `Traverse` is never a candidate.
+
+template <typename Policy>
+class SharedBlock;
+
+template <typename Policy>
+class TracedBlockBase;
+
+template <typename Policy>
+class CycleCollector;
+
+// What one `Collect()` freed
+struct CycleStats {
+    size_t objects = 0;
+    size_t bytes = 0;
+};
+
+// Passed to `Traverse`
+class GcVisitor {
+public:
+    template <typename U, typename Policy>
+    void Visit(const BasicSharedPtr<U, Policy>& ptr) {
+        if (policy_ != Tag<Policy>() || !ptr.GetBlock()) {
+            return;
+        }
+        if (TracedBlockBase<Policy>* block = ptr.GetBlock()->Traced()) {
+            visit_(context_, block);
+        }
+    }
+
+private:
+    template <typename Policy>
+    friend class CycleCollector;
+
+    template <typename Policy>
+    static const void* Tag() {
+        static const char tag = 0;
+        return &tag;
+    }
+
+    GcVisitor(const void* policy, void* context, void (*visit)(void* context, void* block))
+        : policy_(policy), context_(context), visit_(visit) {
+    }
+
+    const void* policy_;
+    void* context_;
+    void (*visit_)(void* context, void* block);
+};
+
+template <typename T, typename = void>
+struct IsTraversable : std::false_type {};
+
+template <typename T>
+struct IsTraversable<T, std::void_t<decltype(std::declval<T&>().Traverse(
+                            std::declval<GcVisitor&>()))>> : std::true_type {};
+
+template <typename T>
+inline constexpr bool kIsTraversable = IsTraversable<T>::value;
+
+// Blocks of traversable objects. The concrete blocks provide `Get()` and `Footprint()`.
+template <typename Policy>
+class TracedBlockBase : public SharedBlock<Policy> {
+public:
+    TracedBlockBase<Policy>* Traced() override {
+        return this;
+    }
+
+    virtual void Traverse(GcVisitor& visitor) = 0;
+    // Bytes freed with the object
+    virtual size_t Footprint() const = 0;
+
+protected:
+    ~TracedBlockBase() {
+        if (collector_) {
+            collector_->Forget(this);
+        }
+    }
+
+private:
+    friend class CycleCollector<Policy>;
+
+    // The collector this block is a candidate of
+    CycleCollector<Policy>* collector_ = nullptr;
+};
+
+template <typename T, typename Policy>
+class TracedBlock : public TracedBlockBase<Policy> {
+public:
+    void Traverse(GcVisitor& visitor) override {
+        Get()->Traverse(visitor);
+    }
+
+    virtual T* Get() = 0;
+
+protected:
+    ~TracedBlock() = default;
+};
+
+template <typename Policy>
+struct IsPlainCount : std::is_same<typename Policy::CountType, PlainCount> {};
+
+template <typename T, typename Policy>
+using BlockBase = std::conditional_t<kIsTraversable<T> && IsPlainCount<Policy>::value,
+                                     TracedBlock<T, Policy>, SharedBlock<Policy>>;
+
+template <typename Policy>
+class CycleCollector {
+    using Block = TracedBlockBase<Policy>;
+
+public:
+    static CycleCollector& Local() {
+        CycleCollector* current = Current();
+        assert(current && "the collector of this thread is already destroyed");
+        return *current;
+    }
+
+    // The collector of the calling thread, null once it is destroyed at thread exit (when
+    // objects with static storage duration may still release references)
+    static CycleCollector* Current() {
+        if (destroyed_) {
+            return nullptr;
+        }
+        thread_local CycleCollector local;
+        return &local;
+    }
+
+    CycleCollector() = default;
+
+    CycleCollector(const CycleCollector&) = delete;
+    CycleCollector& operator=(const CycleCollector&) = delete;
+
+    ~CycleCollector() {
+        std::lock_guard lock(mutex_);
+        for (Block* block : candidates_) {
+            block->collector_ = nullptr;
+        }
+        destroyed_ = true;
+    }
+
+    // A strong reference to `block` went away and others are left
+    void Track(Block* block) {
+        if (collecting_ || block->collector_ == this) {
+            return;
+        }
+        if (block->collector_) {
+            block->collector_->Forget(block);
+        }
+        std::lock_guard lock(mutex_);
+        candidates_.insert(block);
+        block->collector_ = this;
+    }
+
+    // May be called from another thread, when it destroys a block this collector tracked
+    void Forget(Block* block) {
+        std::lock_guard lock(mutex_);
+        candidates_.erase(block);
+        block->collector_ = nullptr;
+    }
+
+    size_t Candidates() const {
+        std::lock_guard lock(mutex_);
+        return candidates_.size();
+    }
+
+    CycleStats Collect() {
+        CycleStats stats;
+        if (collecting_) {
+            return stats;
+        }
+        collecting_ = true;
+
+        // Everything reachable from the candidates, with its strong count
+        std::unordered_map<Block*, int> refs;
+        std::vector<Block*> order;
+        std::vector<Block*> stack;
+        {
+            std::lock_guard lock(mutex_);
+            for (Block* block : candidates_) {
+                block->collector_ = nullptr;
+                if (block->GetStrongCount() > 0) {
+                    stack.push_back(block);
+                }
+            }
+            candidates_.clear();
+        }
+        while (!stack.empty()) {
+            Block* block = stack.back();
+            stack.pop_back();
+            if (!refs.emplace(block, block->GetStrongCount()).second) {
+                continue;
+            }
+            order.push_back(block);
+            ForEachChild(block, [&](Block* child) { stack.push_back(child); });
+        }
+
+        // What is left after the references from inside are taken away comes from outside
+        for (Block* block : order) {
+            ForEachChild(block, [&](Block* child) { --refs[child]; });
+        }
+        for (Block* block : order) {
+            assert(refs[block] >= 0 && "Traverse visited a reference the object does not hold");
+            if (refs[block] > 0) {
+                stack.push_back(block);
+            }
+        }
+        while (!stack.empty()) {
+            Block* block = stack.back();
+            stack.pop_back();
+            ForEachChild(block, [&](Block* child) {
+                if (int& count = refs[child]; count == 0) {
+                    count = 1;
+                    stack.push_back(child);
+                }
+            });
+        }
+
+        std::vector<Block*> garbage;
+        for (Block* block : order) {
+            if (refs[block] == 0) {
+                garbage.push_back(block);
+            }
+        }
+        // The extra reference keeps every block of the cycle alive until all objects are gone
+        for (Block* block : garbage) {
+            block->StrongInc();
+        }
+        for (Block* block : garbage) {
+            stats.bytes += block->Footprint();
+            block->ZeroStrongCount();
+        }
+        for (Block* block : garbage) {
+            block->ExpireCollected();
+        }
+        stats.objects = garbage.size();
+
+        collecting_ = false;
+        return stats;
+    }
+
+private:
+    template <typename F>
+    static void ForEachChild(Block* block, F&& f) {
+        GcVisitor visitor(GcVisitor::Tag<Policy>(), &f, [](void* context, void* child) {
+            (*static_cast<F*>(context))(static_cast<Block*>(child));
+        });
+        block->Traverse(visitor);
+    }
+
+    static inline thread_local bool destroyed_ = false;
+
+    // Guards `candidates_` against blocks destroyed on other threads
+    mutable std::mutex mutex_;
+    std::unordered_set<Block*> candidates_;
+    bool collecting_ = false;
+};
@@ -0,0 +1,246 @@
+#pragma once
+
+#include "reclaim.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Epoch-based reclamation. Readers of a lock-free structure hold an EpochGuard while they use
+// what they found in it; writers unlink an object and `Retire` it instead of destroying it.
+// A retired object is destroyed once every guard that might have seen it is gone: the global
+// epoch advances only when all pinned threads have observed the current one, and an object
+// retired in epoch `e` is destroyed when the epoch reaches `e + 2`.
+//
+// Guards are cheap (a store and a fence, nothing shared is written), nest, and must not be
+// held for long: a stalled reader holds back the reclamation of everything retired meanwhile.
+
+class EpochReclaimer {
+    class ThreadState;
+
+public:
+    // Pins the calling thread in the current epoch
+    class Guard {
+    public:
+        Guard() : local_(Local()) {
+            local_.Pin();
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+        ~Guard() {
+            local_.Unpin();
+        }
+
+    private:
+        ThreadState& local_;
+    };
+
+    // Destroys `pending` once no guard can reach it any more
+    static void Retire(PendingRelease pending) {
+        Local().Retire(pending);
+    }
+
+    // Runs whatever the calling thread retired and may be destroyed by now
+    static void Collect() {
+        Local().Collect();
+    }
+
+    // Destroys everything retired so far by the calling thread and by the threads that have
+    // exited. Waits for the guards of other threads to go away, so it must not be called under
+    // a guard.
+    static void Drain() {
+        Local().Drain();
+    }
+
+    // Objects retired by the calling thread and not destroyed yet
+    static size_t Pending() {
+        return Local().Pending();
+    }
+
+private:
+    static constexpr uint64_t kIdle = ~uint64_t{0};
+    // Retiring this many objects triggers a collection
+    static constexpr size_t kCollectEvery = 64;
+
+    struct Retired {
+        uint64_t epoch;
+        PendingRelease release;
+    };
+
+    // Announced epochs of the threads, never freed; records of finished threads are reused
+    struct alignas(64) Record {
+        std::atomic<uint64_t> epoch = kIdle;
+        std::atomic<bool> in_use = true;
+        Record* next = nullptr;
+    };
+
+    struct Global {
+        std::atomic<uint64_t> epoch = 0;
+        std::atomic<Record*> records = nullptr;
+        // Left behind by threads that exited before their objects could be destroyed
+        std::mutex orphans_mutex;
+        std::vector<Retired> orphans;
+
+        // No thread can be reading at exit
+        ~Global() {
+            for (const Retired& entry : orphans) {
+                entry.release.Run();
+            }
+        }
+    };
+
+    static Global& Shared() {
+        static Global global;
+        return global;
+    }
+
+    static Record* AcquireRecord() {
+        Global& global = Shared();
+        for (Record* record = global.records.load(std::memory_order_acquire); record;
+             record = record->next) {
+            bool expected = false;
+            if (!record->in_use.load(std::memory_order_relaxed) &&
+                record->in_use.compare_exchange_strong(expected, true)) {
+                return record;
+            }
+        }
+        auto* record = new Record;
+        record->next = global.records.load(std::memory_order_relaxed);
+        while (!global.records.compare_exchange_weak(record->next, record,
+                                                     std::memory_order_release)) {
+        }
+        return record;
+    }
+
+    // Moves the epoch forward if every pinned thread is in the current one; returns the epoch
+    static uint64_t TryAdvance() {
+        Global& global = Shared();
+        uint64_t epoch = global.epoch.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (Record* record = global.records.load(std::memory_order_acquire); record;
+             record = record->next) {
+            // Acquire: whatever the thread read under its earlier guards happens before this
+            uint64_t announced = record->epoch.load(std::memory_order_acquire);
+            if (announced != kIdle && announced != epoch) {
+                return epoch;
+            }
+        }
+        global.epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_release,
+                                             std::memory_order_relaxed);
+        return epoch + 1;
+    }
+
+    // Runs the prefix of `retired` that is old enough; entries are in epoch order
+    static void RunExpired(std::vector<Retired>& retired, uint64_t epoch) {
+        size_t expired = 0;
+        while (expired < retired.size() && retired[expired].epoch + 2 <= epoch) {
+            ++expired;
+        }
+        std::vector<Retired> batch(retired.begin(), retired.begin() + expired);
+        retired.erase(retired.begin(), retired.begin() + expired);
+        // Destructors may retire more objects
+        for (const Retired& entry : batch) {
+            entry.release.Run();
+        }
+    }
+
+    class ThreadState {
+    public:
+        ThreadState() : record_(AcquireRecord()) {
+        }
+
+        ThreadState(const ThreadState&) = delete;
+        ThreadState& operator=(const ThreadState&) = delete;
+
+        ~ThreadState() {
+            if (!retired_.empty()) {
+                Global& global = Shared();
+                std::lock_guard lock(global.orphans_mutex);
+                global.orphans.insert(global.orphans.end(), retired_.begin(), retired_.end());
+            }
+            record_->epoch.store(kIdle, std::memory_order_release);
+            record_->in_use.store(false, std::memory_order_release);
+        }
+
+        void Pin() {
+            if (depth_++ == 0) {
+                uint64_t epoch = Shared().epoch.load(std::memory_order_relaxed);
+                record_->epoch.store(epoch, std::memory_order_release);
+                // The announcement must be visible before anything is read under the guard
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+        }
+
+        void Unpin() {
+            if (--depth_ == 0) {
+                record_->epoch.store(kIdle, std::memory_order_release);
+            }
+        }
+
+        void Retire(PendingRelease pending) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            uint64_t epoch = Shared().epoch.load(std::memory_order_relaxed);
+            retired_.push_back({epoch, pending});
+            if (retired_.size() % kCollectEvery == 0) {
+                Collect();
+            }
+        }
+
+        void Collect() {
+            if (collecting_) {
+                return;
+            }
+            collecting_ = true;
+            uint64_t epoch = TryAdvance();
+            RunExpired(retired_, epoch);
+
+            Global& global = Shared();
+            std::unique_lock lock(global.orphans_mutex, std::try_to_lock);
+            if (lock.owns_lock() && !global.orphans.empty()) {
+                std::vector<Retired> orphans = std::move(global.orphans);
+                global.orphans.clear();
+                lock.unlock();
+                RunExpired(orphans, epoch);
+                lock.lock();
+                global.orphans.insert(global.orphans.end(), orphans.begin(), orphans.end());
+            }
+            collecting_ = false;
+        }
+
+        void Drain() {
+            assert(depth_ == 0);
+            while (!retired_.empty() || HasOrphans()) {
+                Collect();
+            }
+        }
+
+        size_t Pending() const {
+            return retired_.size();
+        }
+
+    private:
+        static bool HasOrphans() {
+            Global& global = Shared();
+            std::lock_guard lock(global.orphans_mutex);
+            return !global.orphans.empty();
+        }
+
+        Record* record_;
+        size_t depth_ = 0;
+        bool collecting_ = false;
+        std::vector<Retired> retired_;
+    };
+
+    static ThreadState& Local() {
+        thread_local ThreadState local;
+        return local;
+    }
+};
+
+using EpochGuard = EpochReclaimer::Guard;
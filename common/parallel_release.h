@@ -0,0 +1,262 @@
+#pragma once
+
+#include "reclaim.h"
+#include "shared_fwd.h"
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Tears large object graphs down on a fixed pool of threads.
+// `Release(root)` drops the root on a worker. Every object whose last reference goes away while
+// a worker destroys something is queued on that worker instead of being destroyed in place.
+// The queue is private to the worker (no locking per object) unless another worker is idle:
+// then the object goes to the worker's public deque, from which the idle ones steal.
+// The returned future is ready once everything the root owned is gone.
+//
+// Only the objects released through the pool need thread-safe counts: two subtrees destroyed on
+// different workers may share children. Use AtomicCount with ParallelRelease and AtomicCounter
+// with ParallelDelete.
+
+class ParallelReleasePool {
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    explicit ParallelReleasePool(size_t threads = std::thread::hardware_concurrency()) {
+        if (threads == 0) {
+            threads = 1;
+        }
+        workers_.reserve(threads);
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < threads; ++i) {
+            workers_[i]->thread = std::thread([this, i] { Work(i); });
+        }
+    }
+
+    ParallelReleasePool(const ParallelReleasePool&) = delete;
+    ParallelReleasePool& operator=(const ParallelReleasePool&) = delete;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    // Finishes everything already submitted
+    ~ParallelReleasePool() {
+        {
+            std::lock_guard lock(idle_mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& worker : workers_) {
+            worker->thread.join();
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Submission
+
+    // Takes over `handle` (a SharedPtr, IntrusivePtr, ...) and drops it on a worker
+    template <typename Handle>
+    std::future<void> Release(Handle handle) {
+        auto* holder = new Handle(std::move(handle));
+        return Submit(PendingRelease::Of<Handle, &DropHandle<Handle>>(holder));
+    }
+
+    std::future<void> Submit(PendingRelease root) {
+        auto* batch = new Batch;
+        std::future<void> done = batch->done.get_future();
+        Push(*workers_[next_.fetch_add(1, std::memory_order_relaxed) % workers_.size()],
+             {root, batch});
+        return done;
+    }
+
+    // Called by the release hooks. Queues `pending` on the current worker, in the batch of the
+    // object being destroyed; returns false when the calling thread is not a worker.
+    static bool Defer(PendingRelease pending) {
+        Context& context = Current();
+        Worker* worker = context.worker;
+        if (!worker) {
+            return false;
+        }
+        if (context.pool->sleeping_.load(std::memory_order_relaxed) > 0 &&
+            worker->published.load(std::memory_order_relaxed) == 0) {
+            context.batch->pending.fetch_add(1, std::memory_order_relaxed);
+            context.pool->Push(*worker, {pending, context.batch});
+        } else {
+            worker->local.push_back(pending);
+        }
+        return true;
+    }
+
+    size_t Threads() const {
+        return workers_.size();
+    }
+
+private:
+    // Everything reachable from one submitted root
+    struct Batch {
+        std::atomic<size_t> pending = 1;
+        std::promise<void> done;
+    };
+
+    struct Task {
+        PendingRelease release;
+        Batch* batch;
+    };
+
+    struct Worker {
+        // Owner only; all of it belongs to the batch being run
+        std::vector<PendingRelease> local;
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::atomic<size_t> published = 0;
+        std::thread thread;
+    };
+
+    struct Context {
+        ParallelReleasePool* pool = nullptr;
+        Worker* worker = nullptr;
+        Batch* batch = nullptr;
+    };
+
+    template <typename Handle>
+    static void DropHandle(Handle* holder) {
+        delete holder;
+    }
+
+    static Context& Current() {
+        thread_local Context context;
+        return context;
+    }
+
+    void Push(Worker& worker, Task task) {
+        // Counted before it can be popped, so `queued_` never drops below the tasks in the
+        // deques; a worker that sees the count early retries until the task lands. Pairs with
+        // the check in `Work`: either the sleeper sees the task or we see the sleeper.
+        queued_.fetch_add(1);
+        {
+            std::lock_guard lock(worker.mutex);
+            worker.tasks.push_back(task);
+            worker.published.store(worker.tasks.size(), std::memory_order_relaxed);
+        }
+        if (sleeping_.load() > 0) {
+            std::lock_guard lock(idle_mutex_);
+            wake_.notify_one();
+        }
+    }
+
+    // The owner takes its newest public task, thieves take the oldest ones
+    bool Pop(size_t index, Task& task) {
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            Worker& worker = *workers_[(index + i) % workers_.size()];
+            std::lock_guard lock(worker.mutex);
+            if (worker.tasks.empty()) {
+                continue;
+            }
+            if (i == 0) {
+                task = worker.tasks.back();
+                worker.tasks.pop_back();
+            } else {
+                task = worker.tasks.front();
+                worker.tasks.pop_front();
+            }
+            worker.published.store(worker.tasks.size(), std::memory_order_relaxed);
+            [[maybe_unused]] size_t queued = queued_.fetch_sub(1);
+            assert(queued > 0);
+            return true;
+        }
+        return false;
+    }
+
+    // Runs `task` and everything it queues privately
+    void Run(Task task) {
+        Context& context = Current();
+        std::vector<PendingRelease>& local = context.worker->local;
+        context.batch = task.batch;
+        task.release.Run();
+        while (!local.empty()) {
+            PendingRelease next = local.back();
+            local.pop_back();
+            next.Run();
+        }
+        context.batch = nullptr;
+        if (task.batch->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            task.batch->done.set_value();
+            delete task.batch;
+        }
+    }
+
+    void Work(size_t index) {
+        Context& context = Current();
+        context.pool = this;
+        context.worker = workers_[index].get();
+
+        Task task;
+        while (true) {
+            if (Pop(index, task)) {
+                Run(task);
+                continue;
+            }
+            std::unique_lock lock(idle_mutex_);
+            sleeping_.fetch_add(1);
+            wake_.wait(lock, [this] { return stop_ || queued_.load() > 0; });
+            sleeping_.fetch_sub(1);
+            if (stop_ && queued_.load() == 0) {
+                return;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> next_ = 0;
+    std::atomic<size_t> queued_ = 0;
+    std::atomic<size_t> sleeping_ = 0;
+    std::mutex idle_mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Hooks
+
+// Release policy for SharedPolicy. Outside the pool it behaves like IterativeRelease.
+struct ParallelRelease {
+    template <typename Block>
+    static void Release(Block* block) {
+        static_assert(std::is_same_v<typename Block::PolicyType::CountType, AtomicCount>,
+                      "objects released in parallel need atomic counts");
+        auto pending = PendingRelease::Of<Block, &ExpireBlock<Block>>(block);
+        if (!ParallelReleasePool::Defer(pending)) {
+            IterativeReclaimer::Release(pending);
+        }
+    }
+};
+
+// From intrusive/intrusive.h
+struct DefaultDelete;
+class AtomicCounter;
+
+// Deleter policy for RefCounted. Outside the pool it behaves like IterativeDelete.
+template <typename Deleter = DefaultDelete>
+struct ParallelDelete {
+    template <typename T>
+    static void Destroy(T* object) {
+        static_assert(std::is_same_v<typename T::CounterType, AtomicCounter>,
+                      "objects released in parallel need atomic counters");
+        auto pending = PendingRelease::Of<T, &Deleter::template Destroy<T>>(object);
+        if (!ParallelReleasePool::Defer(pending)) {
+            IterativeReclaimer::Release(pending);
+        }
+    }
+};
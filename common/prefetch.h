@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+// Software prefetch for containers of pointers. Walking a vector of pointers to objects spread
+// over the heap costs one cache miss per element. The core overlaps the misses only as far as
+// its reorder window reaches, which for a loop body of any size is an element or two.
+// The algorithms below request the targets a few elements ahead so that they are in cache by
+// the time the loop reaches them. A loop that does almost nothing per element gains little.
+//
+// Every pointer type has `PrefetchTarget()`; the shared ones also have `PrefetchCounts()` for
+// the cache line holding the reference counts, which is what copying a pointer touches.
+
+// Starts loading the cache line at `address`; never faults, null is fine
+inline void PrefetchRead(const void* address) {
+#if defined(__GNUC__)
+    __builtin_prefetch(address, 0, 3);
+#else
+    (void)address;
+#endif
+}
+
+inline void PrefetchWrite(const void* address) {
+#if defined(__GNUC__)
+    __builtin_prefetch(address, 1, 3);
+#else
+    (void)address;
+#endif
+}
+
+// Far enough to cover the latency of a miss for a cheap loop body, close enough not to evict
+// the lines again before they are used
+inline constexpr size_t kPrefetchDistance = 8;
+
+namespace prefetch_detail {
+
+template <typename P, typename = void>
+struct HasCounts : std::false_type {};
+
+template <typename P>
+struct HasCounts<P, std::void_t<decltype(std::declval<const P&>().PrefetchCounts())>>
+    : std::true_type {};
+
+template <typename P>
+void Target(const P& ptr) {
+    if constexpr (std::is_pointer_v<P>) {
+        PrefetchRead(ptr);
+    } else {
+        ptr.PrefetchTarget();
+    }
+}
+
+// Copies and releases touch the counts only
+template <typename P>
+void Counts(const P& ptr) {
+    if constexpr (HasCounts<P>::value) {
+        ptr.PrefetchCounts();
+    } else {
+        Target(ptr);
+    }
+}
+
+// Calls `prefetch` on the element `distance` ahead of the one passed to `f`
+template <typename Range, typename Prefetch, typename F>
+void Walk(Range&& range, size_t distance, Prefetch prefetch, F&& f) {
+    auto end = std::end(range);
+    auto ahead = std::begin(range);
+    for (size_t i = 0; i < distance && ahead != end; ++i, ++ahead) {
+        prefetch(*ahead);
+    }
+    for (auto it = std::begin(range); it != end; ++it) {
+        if (ahead != end) {
+            prefetch(*ahead);
+            ++ahead;
+        }
+        f(*it);
+    }
+}
+
+}  // namespace prefetch_detail
+
+// Calls `f(*ptr)` for every non-null pointer in `range`
+template <typename Range, typename F>
+void ForEachDeref(Range&& range, F&& f, size_t distance = kPrefetchDistance) {
+    prefetch_detail::Walk(
+        range, distance, [](const auto& ptr) { prefetch_detail::Target(ptr); },
+        [&f](const auto& ptr) {
+            if (ptr) {
+                f(*ptr);
+            }
+        });
+}
+
+// Calls `f(ptr)` for every pointer in `range`, prefetching the reference counts instead of the
+// targets; for loops that copy or release the pointers
+template <typename Range, typename F>
+void ForEachPtr(Range&& range, F&& f, size_t distance = kPrefetchDistance) {
+    prefetch_detail::Walk(
+        range, distance, [](const auto& ptr) { prefetch_detail::Counts(ptr); }, f);
+}
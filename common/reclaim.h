@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Deferred destruction of objects whose last reference is gone.
+// Destroying an object may drop the last references to others; instead of recursing into them,
+// the release hooks push them here. Both reclaimers are per thread.
+
+// One object waiting to be destroyed
+struct PendingRelease {
+    void* object;
+    void (*release)(void* object);
+
+    template <typename T, void (*Release)(T*)>
+    static PendingRelease Of(T* object) {
+        return {object, [](void* ptr) { Release(static_cast<T*>(ptr)); }};
+    }
+
+    void Run() const {
+        release(object);
+    }
+};
+
+// Release hook of the shared control blocks
+template <typename Block>
+void ExpireBlock(Block* block) {
+    block->Expire();
+}
+
+// Destroys everything before returning, but iteratively: the outermost release drains
+// a queue the nested ones push to, so the stack depth does not grow with the graph depth.
+class IterativeReclaimer {
+public:
+    static void Release(PendingRelease pending) {
+        thread_local IterativeReclaimer local;
+        local.queue_.push_back(pending);
+        if (local.draining_) {
+            return;
+        }
+        local.draining_ = true;
+        while (!local.queue_.empty()) {
+            PendingRelease next = local.queue_.back();
+            local.queue_.pop_back();
+            next.Run();
+        }
+        local.draining_ = false;
+    }
+
+private:
+    std::vector<PendingRelease> queue_;
+    bool draining_ = false;
+};
+
+// Collects released objects until the owner of the thread calls `Step`, so that a large
+// teardown can be spread over several iterations of an event loop.
+// Whatever is left is destroyed when the thread exits.
+class IncrementalReclaimer {
+public:
+    static IncrementalReclaimer& Local() {
+        thread_local IncrementalReclaimer local;
+        return local;
+    }
+
+    void Push(PendingRelease pending) {
+        queue_.push_back(pending);
+    }
+
+    // Destroys at most `budget` objects; returns how many were destroyed
+    size_t Step(size_t budget) {
+        size_t done = 0;
+        while (done < budget && !queue_.empty()) {
+            PendingRelease next = queue_.back();
+            queue_.pop_back();
+            next.Run();
+            ++done;
+        }
+        return done;
+    }
+
+    size_t Pending() const {
+        return queue_.size();
+    }
+
+    ~IncrementalReclaimer() {
+        while (Step(queue_.size()) > 0) {
+        }
+    }
+
+private:
+    std::vector<PendingRelease> queue_;
+};
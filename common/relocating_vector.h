@@ -0,0 +1,199 @@
+#pragma once
+
+#include "allocation.h"
+#include "relocation.h"
+
+#include <cstddef>
+#include <cstdint>  // PTRDIFF_MAX
+#include <cstdlib>  // std::malloc / std::realloc / std::free
+#include <cstring>  // std::memcpy / std::memmove
+#include <memory>   // std::uninitialized_move_n / std::destroy_n
+#include <new>      // std::bad_alloc
+#include <stdexcept>  // std::length_error
+#include <utility>
+
+// Minimal vector that relocates trivially relocatable elements with realloc/memmove
+// instead of move-constructing and destroying them one by one.
+template <typename T>
+class RelocatingVector {
+public:
+    RelocatingVector() : data_(nullptr), size_(0), capacity_(0) {
+    }
+
+    RelocatingVector(const RelocatingVector&) = delete;
+
+    RelocatingVector(RelocatingVector&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)),
+          size_(std::exchange(other.size_, 0)),
+          capacity_(std::exchange(other.capacity_, 0)) {
+    }
+
+    RelocatingVector& operator=(const RelocatingVector&) = delete;
+
+    RelocatingVector& operator=(RelocatingVector&& other) noexcept {
+        RelocatingVector(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ~RelocatingVector() {
+        Clear();
+        Free(data_, capacity_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    template <typename... Args>
+    T& EmplaceBack(Args&&... args) {
+        if (size_ == capacity_) {
+            // `args` may refer to an element, which growing moves away: construct it first
+            T value(std::forward<Args>(args)...);
+            Reserve(capacity_ == 0 ? 1 : capacity_ * 2);
+            return *new (data_ + size_++) T(std::move(value));
+        }
+        T* slot = new (data_ + size_) T(std::forward<Args>(args)...);
+        ++size_;
+        return *slot;
+    }
+
+    void PushBack(const T& value) {
+        EmplaceBack(value);
+    }
+
+    void PushBack(T&& value) {
+        EmplaceBack(std::move(value));
+    }
+
+    void PopBack() {
+        --size_;
+        data_[size_].~T();
+    }
+
+    void Erase(size_t index) {
+        Erase(index, index + 1);
+    }
+
+    // Removes elements [first, last)
+    void Erase(size_t first, size_t last) {
+        if (first == last) {
+            return;
+        }
+        if constexpr (kIsTriviallyRelocatable<T>) {
+            std::destroy_n(data_ + first, last - first);
+            std::memmove(static_cast<void*>(data_ + first), data_ + last,
+                         (size_ - last) * sizeof(T));
+        } else {
+            std::move(data_ + last, data_ + size_, data_ + first);
+            std::destroy_n(data_ + size_ - (last - first), last - first);
+        }
+        size_ -= last - first;
+    }
+
+    void Clear() {
+        std::destroy_n(data_, size_);
+        size_ = 0;
+    }
+
+    // Throws std::length_error beyond MaxSize()
+    void Reserve(size_t capacity) {
+        if (capacity <= capacity_) {
+            return;
+        }
+        if (capacity > MaxSize()) {
+            throw std::length_error("RelocatingVector::Reserve");
+        }
+        if constexpr (kUseRealloc) {
+            void* data = std::realloc(static_cast<void*>(data_), capacity * sizeof(T));
+            if (!data) {
+                throw std::bad_alloc();
+            }
+            data_ = static_cast<T*>(data);
+        } else {
+            T* data = static_cast<T*>(Allocate(capacity * sizeof(T), alignof(T)));
+            if constexpr (kIsTriviallyRelocatable<T>) {
+                std::memcpy(static_cast<void*>(data), data_, size_ * sizeof(T));
+            } else {
+                try {
+                    std::uninitialized_move_n(data_, size_, data);
+                } catch (...) {
+                    Free(data, capacity);
+                    throw;
+                }
+                std::destroy_n(data_, size_);
+            }
+            Free(data_, capacity_);
+            data_ = data;
+        }
+        capacity_ = capacity;
+    }
+
+    void Swap(RelocatingVector& other) {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    size_t Size() const {
+        return size_;
+    }
+
+    size_t Capacity() const {
+        return capacity_;
+    }
+
+    // Doubling a capacity up to this cannot overflow the byte size
+    static constexpr size_t MaxSize() {
+        return static_cast<size_t>(PTRDIFF_MAX) / sizeof(T);
+    }
+
+    bool Empty() const {
+        return size_ == 0;
+    }
+
+    T& operator[](size_t index) {
+        return data_[index];
+    }
+
+    const T& operator[](size_t index) const {
+        return data_[index];
+    }
+
+    T* begin() {
+        return data_;
+    }
+
+    T* end() {
+        return data_ + size_;
+    }
+
+    const T* begin() const {
+        return data_;
+    }
+
+    const T* end() const {
+        return data_ + size_;
+    }
+
+private:
+    // realloc only guarantees fundamental alignment
+    static constexpr bool kUseRealloc =
+        kIsTriviallyRelocatable<T> && alignof(T) <= alignof(std::max_align_t);
+
+    static void Free(T* data, size_t capacity) {
+        if (!data) {
+            return;
+        }
+        if constexpr (kUseRealloc) {
+            std::free(data);
+        } else {
+            Deallocate(data, capacity * sizeof(T), alignof(T));
+        }
+    }
+
+    T* data_;
+    size_t size_;
+    size_t capacity_;
+};
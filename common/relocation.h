@@ -0,0 +1,14 @@
+#pragma once
+
+#include <type_traits>
+
+// A type is trivially relocatable if moving an object to a new address and ending the lifetime
+// of the old one is equivalent to copying its bytes. Containers may then grow and erase with
+// memcpy/memmove/realloc instead of running move constructors and destructors.
+// Trivially copyable types qualify; smart pointers opt in by specializing the trait next to
+// their definition.
+template <typename T>
+struct IsTriviallyRelocatable : std::bool_constant<std::is_trivially_copyable_v<T>> {};
+
+template <typename T>
+inline constexpr bool kIsTriviallyRelocatable = IsTriviallyRelocatable<T>::value;
@@ -0,0 +1,909 @@
+#pragma once
+
+#include "allocation.h"
+#include "bulk.h"
+#include "cycles.h"
+#include "prefetch.h"
+#include "reclaim.h"
+#include "relocation.h"
+#include "shared_fwd.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>  // std::nullptr_t
+#include <type_traits>
+#include <utility>
+
+// Shared ownership built from policies. A configuration picks
+//   - how counts are kept: PlainCount (single-threaded) or AtomicCount;
+//   - whether weak references exist: NoWeak (the block has a strong count only) or WithWeak;
+//   - whether SharedFromThis is linked up: NoSharedFromThis or WithSharedFromThis;
+//   - how control blocks are allocated: DefaultAllocation or a type with the same interface;
+//   - what happens when the last strong reference goes away: ImmediateRelease destroys the
+//     object right there (recursing into the objects it owned), IterativeRelease does the same
+//     with a bounded stack, IncrementalRelease leaves it to IncrementalReclaimer::Step.
+// Objects with a `Traverse` hook may be reclaimed by the cycle collector (cycles.h).
+// shared/, weak/ and shared-from-this/ are configurations of this core.
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Counting policies
+
+// Not thread-safe, like the counters of IntrusivePtr's SimpleCounter
+class PlainCount {
+public:
+    explicit PlainCount(int initial) : count_(initial) {
+    }
+
+    void Inc() {
+        ++count_;
+    }
+
+    // Returns true when the count drops to zero
+    bool Dec() {
+        return --count_ == 0;
+    }
+
+    bool IncIfNonZero() {
+        if (count_ == 0) {
+            return false;
+        }
+        ++count_;
+        return true;
+    }
+
+    int Get() const {
+        return count_;
+    }
+
+private:
+    int count_;
+};
+
+class AtomicCount {
+public:
+    explicit AtomicCount(int initial) : count_(initial) {
+    }
+
+    void Inc() {
+        count_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // The last owner must see every write made through the other owners
+    bool Dec() {
+        return count_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    void Add(int n) {
+        count_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    bool Sub(int n) {
+        return count_.fetch_sub(n, std::memory_order_acq_rel) == n;
+    }
+
+    bool IncIfNonZero() {
+        int count = count_.load(std::memory_order_relaxed);
+        while (count != 0) {
+            if (count_.compare_exchange_weak(count, count + 1, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int Get() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int> count_;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Weak, SharedFromThis and allocation policies
+
+struct NoWeak {
+    static constexpr bool kEnabled = false;
+};
+
+struct WithWeak {
+    static constexpr bool kEnabled = true;
+};
+
+struct NoSharedFromThis {
+    static constexpr bool kEnabled = false;
+};
+
+struct WithSharedFromThis {
+    static constexpr bool kEnabled = true;
+};
+
+struct DefaultAllocation {
+    template <typename Block, typename... Args>
+    static Block* New(Args&&... args) {
+        return new Block(std::forward<Args>(args)...);
+    }
+
+    template <typename Block>
+    static void Delete(Block* block) {
+        DeleteObject(block);
+    }
+};
+
+// Release policies receive a block whose strong count has dropped to zero and call its
+// `Expire()` now or later (ParallelRelease in parallel_release.h hands it to a worker pool)
+
+struct ImmediateRelease {
+    template <typename Block>
+    static void Release(Block* block) {
+        block->Expire();
+    }
+};
+
+struct IterativeRelease {
+    template <typename Block>
+    static void Release(Block* block) {
+        IterativeReclaimer::Release(PendingRelease::Of<Block, &ExpireBlock<Block>>(block));
+    }
+};
+
+struct IncrementalRelease {
+    template <typename Block>
+    static void Release(Block* block) {
+        IncrementalReclaimer::Local().Push(PendingRelease::Of<Block, &ExpireBlock<Block>>(block));
+    }
+};
+
+template <typename Count, typename Weak, typename SharedFromThis, typename Allocation,
+          typename Release>
+struct SharedPolicy {
+    using CountType = Count;
+    using AllocationType = Allocation;
+    using ReleaseType = Release;
+
+    static constexpr bool kWeak = Weak::kEnabled;
+    static constexpr bool kSharedFromThis = SharedFromThis::kEnabled;
+
+    static_assert(kWeak || !kSharedFromThis, "SharedFromThis is a weak reference");
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Control blocks
+
+// Without weak references the block only carries the strong count
+struct NoCount {
+    explicit NoCount(int) {
+    }
+};
+
+// A new block is owned by one SharedPtr. While the object is alive, all strong references
+// together hold one weak reference, so the block goes away with the last reference of any kind.
+template <typename Policy>
+class SharedBlock {
+    using Count = typename Policy::CountType;
+
+public:
+    using PolicyType = Policy;
+
+    SharedBlock() : strong_(1), weak_(1) {
+    }
+
+    SharedBlock(const SharedBlock&) = delete;
+    SharedBlock& operator=(const SharedBlock&) = delete;
+
+    void StrongInc() {
+        strong_.Inc();
+    }
+
+    // Takes a strong reference unless the object is already gone
+    bool StrongIncIfNonZero() {
+        return strong_.IncIfNonZero();
+    }
+
+    void StrongRelease() {
+        if (strong_.Dec()) {
+            Policy::ReleaseType::Release(this);
+        }
+    }
+
+    // StrongRelease through a pointer to a traversable type
+    void StrongReleaseTracked() {
+        if (strong_.Dec()) {
+            Policy::ReleaseType::Release(this);
+        } else if (TracedBlockBase<Policy>* traced = Traced()) {
+            if (CycleCollector<Policy>* collector = CycleCollector<Policy>::Current()) {
+                collector->Track(traced);
+            }
+        }
+    }
+
+    // `n` references at once, for the bulk operations (see bulk.h)
+    void StrongAdd(int n) {
+        strong_.Add(n);
+    }
+
+    void StrongSub(int n) {
+        if (strong_.Sub(n)) {
+            Policy::ReleaseType::Release(this);
+        }
+    }
+
+    void StrongSubTracked(int n) {
+        if (strong_.Sub(n)) {
+            Policy::ReleaseType::Release(this);
+        } else if (TracedBlockBase<Policy>* traced = Traced()) {
+            if (CycleCollector<Policy>* collector = CycleCollector<Policy>::Current()) {
+                collector->Track(traced);
+            }
+        }
+    }
+
+    // Destroys the object and drops the weak reference the strong owners held
+    void Expire() {
+        ZeroStrongCount();
+        if constexpr (Policy::kWeak) {
+            WeakRelease();
+        } else {
+            Destroy();
+        }
+    }
+
+    // The cycle collector destroyed the object while holding the last strong reference
+    void ExpireCollected() {
+        [[maybe_unused]] bool last = strong_.Dec();
+        assert(last);
+        if constexpr (Policy::kWeak) {
+            WeakRelease();
+        } else {
+            Destroy();
+        }
+    }
+
+    int GetStrongCount() const {
+        return strong_.Get();
+    }
+
+    void WeakInc() {
+        static_assert(Policy::kWeak, "this configuration has no weak references");
+        weak_.Inc();
+    }
+
+    void WeakRelease() {
+        static_assert(Policy::kWeak, "this configuration has no weak references");
+        if (weak_.Dec()) {
+            Destroy();
+        }
+    }
+
+    // Destroys the object
+    virtual void ZeroStrongCount() = 0;
+    // Releases the block itself with its static size and alignment
+    virtual void Destroy() = 0;
+    // Non-null for blocks the cycle collector can look into
+    virtual TracedBlockBase<Policy>* Traced() {
+        return nullptr;
+    }
+
+protected:
+    ~SharedBlock() = default;
+
+private:
+    Count strong_;
+    [[no_unique_address]] std::conditional_t<Policy::kWeak, Count, NoCount> weak_;
+};
+
+template <typename T, typename Policy>
+class SharedPtrBlock final : public BlockBase<T, Policy> {
+public:
+    explicit SharedPtrBlock(T* ptr) : ptr_(ptr) {
+    }
+
+    void ZeroStrongCount() override {
+        DeleteObject(ptr_);
+        ptr_ = nullptr;
+    }
+
+    void Destroy() override {
+        Policy::AllocationType::Delete(this);
+    }
+
+    T* Get() {
+        return ptr_;
+    }
+
+    size_t Footprint() const {
+        return sizeof(*this) + sizeof(T);
+    }
+
+private:
+    T* ptr_;
+};
+
+// Owns a pointer released by a custom deleter, e.g. one taken over from a UniquePtr<T, D>
+// or storage that came from a pool
+template <typename T, typename D, typename Policy>
+class SharedDeleterBlock final : public BlockBase<T, Policy> {
+public:
+    SharedDeleterBlock(T* ptr, D&& deleter) : ptr_(ptr), deleter_(std::move(deleter)) {
+    }
+
+    void ZeroStrongCount() override {
+        deleter_(ptr_);
+        ptr_ = nullptr;
+    }
+
+    void Destroy() override {
+        Policy::AllocationType::Delete(this);
+    }
+
+    T* Get() {
+        return ptr_;
+    }
+
+    size_t Footprint() const {
+        return sizeof(*this) + sizeof(T);
+    }
+
+private:
+    T* ptr_;
+    [[no_unique_address]] D deleter_;
+};
+
+// The object lives inside the block (one allocation, see MakeBasicShared)
+template <typename T, typename Policy>
+class SharedValueBlock final : public BlockBase<T, Policy> {
+public:
+    template <typename... Args>
+    explicit SharedValueBlock(Args&&... args) {
+        new (&buffer_) T(std::forward<Args>(args)...);
+    }
+
+    void ZeroStrongCount() override {
+        Get()->~T();
+    }
+
+    void Destroy() override {
+        Policy::AllocationType::Delete(this);
+    }
+
+    T* Get() {
+        return reinterpret_cast<T*>(&buffer_);
+    }
+
+    size_t Footprint() const {
+        return sizeof(*this);
+    }
+
+private:
+    alignas(T) std::byte buffer_[sizeof(T)];
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// References to a block
+
+// Block pointer plus object pointer holding one strong (or weak) reference. Copies take another
+// reference. SharedPtr and WeakPtr leave their copy and move operations to this class, which also
+// keeps class template argument deduction (`SharedPtr b(a)`) working through the aliases the
+// task directories define.
+template <typename T, typename Policy, bool kWeakRef>
+class BlockRef {
+public:
+    using Block = SharedBlock<Policy>;
+
+    BlockRef() : block_(nullptr), ptr_(nullptr) {
+    }
+
+    // Adopts a reference that is already counted
+    BlockRef(Block* block, T* ptr) : block_(block), ptr_(ptr) {
+    }
+
+    BlockRef(const BlockRef& other) : block_(other.block_), ptr_(other.ptr_) {
+        Acquire(block_);
+    }
+
+    BlockRef(BlockRef&& other)
+        : block_(std::exchange(other.block_, nullptr)), ptr_(std::exchange(other.ptr_, nullptr)) {
+    }
+
+    BlockRef& operator=(const BlockRef& other) {
+        BlockRef(other).Swap(*this);
+        return *this;
+    }
+
+    BlockRef& operator=(BlockRef&& other) {
+        BlockRef(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ~BlockRef() {
+        if (block_) {
+            if constexpr (kWeakRef) {
+                block_->WeakRelease();
+            } else if constexpr (kIsTraversable<std::remove_cv_t<T>>) {
+                block_->StrongReleaseTracked();
+            } else {
+                block_->StrongRelease();
+            }
+        }
+    }
+
+    void Swap(BlockRef& other) {
+        std::swap(block_, other.block_);
+        std::swap(ptr_, other.ptr_);
+    }
+
+    Block* GetBlock() const {
+        return block_;
+    }
+
+    T* GetPtr() const {
+        return ptr_;
+    }
+
+    void SetBlock(Block* block) {
+        block_ = block;
+    }
+
+    void SetPtr(T* ptr) {
+        ptr_ = ptr;
+    }
+
+protected:
+    static void Acquire(Block* block) {
+        if (block) {
+            if constexpr (kWeakRef) {
+                block->WeakInc();
+            } else {
+                block->StrongInc();
+            }
+        }
+    }
+
+private:
+    Block* block_;
+    T* ptr_;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// SharedPtr
+
+// https://en.cppreference.com/w/cpp/memory/shared_ptr
+template <typename T, typename Policy>
+class BasicSharedPtr : public BlockRef<T, Policy, false> {
+    using Base = BlockRef<T, Policy, false>;
+    using Block = SharedBlock<Policy>;
+
+    template <typename Y, typename P, typename... Args>
+    friend BasicSharedPtr<Y, P> MakeBasicShared(Args&&... args);
+
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    BasicSharedPtr() = default;
+
+    BasicSharedPtr(std::nullptr_t) {
+    }
+
+    template <typename Y>
+    explicit BasicSharedPtr(Y* ptr)
+        : Base(ptr ? Policy::AllocationType::template New<SharedPtrBlock<Y, Policy>>(ptr)
+                   : nullptr,
+               ptr) {
+        LinkSharedFromThis(ptr);
+    }
+
+    // Takes `ptr` over with `deleter`; the only allocation is the control block.
+    // If that allocation throws, `deleter(ptr)` is called.
+    template <typename Y, typename D,
+              typename = std::enable_if_t<!std::is_convertible_v<D, Block*>>>
+    BasicSharedPtr(Y* ptr, D deleter) : Base(NewDeleterBlock(ptr, deleter), ptr) {
+        LinkSharedFromThis(ptr);
+    }
+
+    // Adopts the object and the deleter of `other`, which keeps ownership if this throws
+    template <typename Y, typename D>
+    BasicSharedPtr(UniquePtr<Y, D>&& other) {
+        if (Y* ptr = other.Get()) {
+            this->SetBlock(Policy::AllocationType::template New<SharedDeleterBlock<Y, D, Policy>>(
+                ptr, std::move(other.GetDeleter())));
+            this->SetPtr(other.Release());
+            LinkSharedFromThis(ptr);
+        }
+    }
+
+    template <typename Y>
+    BasicSharedPtr(const BasicSharedPtr<Y, Policy>& other)
+        : Base(other.GetBlock(), other.GetPtr()) {
+        Base::Acquire(this->GetBlock());
+    }
+
+    template <typename Y>
+    BasicSharedPtr(BasicSharedPtr<Y, Policy>&& other) : Base(other.GetBlock(), other.GetPtr()) {
+        other.SetBlock(nullptr);
+        other.SetPtr(nullptr);
+    }
+
+    // Adopts one strong reference of `block`
+    BasicSharedPtr(T* ptr, Block* block) : Base(block, ptr) {
+    }
+
+    // Aliasing constructor
+    // #8 from https://en.cppreference.com/w/cpp/memory/shared_ptr/shared_ptr
+    template <typename Y>
+    BasicSharedPtr(const BasicSharedPtr<Y, Policy>& other, T* ptr) : Base(other.GetBlock(), ptr) {
+        Base::Acquire(this->GetBlock());
+    }
+
+    // Promote `WeakPtr`; throws BadWeakPtr if it has expired (see WeakPtr::TryLock)
+    // #11 from https://en.cppreference.com/w/cpp/memory/shared_ptr/shared_ptr
+    explicit BasicSharedPtr(const BasicWeakPtr<T, Policy>& other) {
+        Block* block = other.GetBlock();
+        if (!block || !block->StrongIncIfNonZero()) {
+            ThrowBadWeakPtr();
+        }
+        this->SetBlock(block);
+        this->SetPtr(other.GetPtr());
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    void Reset() {
+        BasicSharedPtr().Swap(*this);
+    }
+
+    template <typename Y>
+    void Reset(Y* ptr) {
+        BasicSharedPtr(ptr).Swap(*this);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    T* Get() const {
+        return this->GetPtr();
+    }
+
+    std::add_lvalue_reference_t<T> operator*() const {
+        return *Get();
+    }
+
+    T* operator->() const {
+        return Get();
+    }
+
+    size_t UseCount() const {
+        if (Block* block = this->GetBlock()) {
+            return static_cast<size_t>(block->GetStrongCount());
+        }
+        return 0;
+    }
+
+    explicit operator bool() const {
+        return Get() != nullptr;
+    }
+
+    void PrefetchTarget() const {
+        PrefetchRead(this->GetPtr());
+    }
+
+    // Copies and releases write to the control block
+    void PrefetchCounts() const {
+        PrefetchWrite(this->GetBlock());
+    }
+
+private:
+    template <typename Y, typename D>
+    static Block* NewDeleterBlock(Y* ptr, D& deleter) {
+        if (!ptr) {
+            return nullptr;
+        }
+#ifdef SMART_PTR_NO_EXCEPTIONS
+        // A failed allocation terminates, there is nothing to clean up after
+        return Policy::AllocationType::template New<SharedDeleterBlock<Y, D, Policy>>(
+            ptr, std::move(deleter));
+#else
+        try {
+            return Policy::AllocationType::template New<SharedDeleterBlock<Y, D, Policy>>(
+                ptr, std::move(deleter));
+        } catch (...) {
+            deleter(ptr);
+            throw;
+        }
+#endif
+    }
+
+    // Points the weak self-reference of a new object at its control block
+    template <typename Y>
+    void LinkSharedFromThis(Y* ptr) {
+        if constexpr (Policy::kSharedFromThis) {
+            if (ptr) {
+                LinkWeakThis(ptr, ptr);
+            }
+        }
+    }
+
+    template <typename U, typename Y>
+    void LinkWeakThis(const BasicEnableSharedFromThis<U, Policy>* base, Y* ptr) {
+        base->Link(this->GetBlock(), ptr);
+    }
+
+    void LinkWeakThis(...) {
+    }
+};
+
+template <typename T, typename Policy>
+struct IsTriviallyRelocatable<BasicSharedPtr<T, Policy>> : std::true_type {};
+
+template <typename T, typename Policy>
+struct BulkCounts<BasicSharedPtr<T, Policy>> {
+    static constexpr bool kCoalesce = std::is_same_v<typename Policy::CountType, AtomicCount>;
+
+    using Pointer = BasicSharedPtr<T, Policy>;
+    using Key = SharedBlock<Policy>;
+
+    static Key* KeyOf(const Pointer& ptr) {
+        return ptr.GetBlock();
+    }
+
+    static Pointer CopyUncounted(const Pointer& ptr) {
+        return Pointer(ptr.GetPtr(), ptr.GetBlock());
+    }
+
+    static void Forget(Pointer& ptr) {
+        ptr.SetBlock(nullptr);
+        ptr.SetPtr(nullptr);
+    }
+
+    static void Add(Key* block, size_t n) {
+        block->StrongAdd(static_cast<int>(n));
+    }
+
+    static void Sub(Key* block, size_t n) {
+        if constexpr (kIsTraversable<std::remove_cv_t<T>>) {
+            block->StrongSubTracked(static_cast<int>(n));
+        } else {
+            block->StrongSub(static_cast<int>(n));
+        }
+    }
+};
+
+template <typename T, typename U, typename Policy>
+bool operator==(const BasicSharedPtr<T, Policy>& left, const BasicSharedPtr<U, Policy>& right) {
+    return left.Get() == right.Get();
+}
+
+// Allocate memory only once
+template <typename T, typename Policy, typename... Args>
+BasicSharedPtr<T, Policy> MakeBasicShared(Args&&... args) {
+    using Block = SharedValueBlock<T, Policy>;
+    auto* block = Policy::AllocationType::template New<Block>(std::forward<Args>(args)...);
+    BasicSharedPtr<T, Policy> result(block->Get(), block);
+    result.LinkSharedFromThis(block->Get());
+    return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// WeakPtr
+
+// https://en.cppreference.com/w/cpp/memory/weak_ptr
+template <typename T, typename Policy>
+class BasicWeakPtr : public BlockRef<T, Policy, true> {
+    using Base = BlockRef<T, Policy, true>;
+    using Block = SharedBlock<Policy>;
+
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    BasicWeakPtr() = default;
+
+    template <typename U>
+    BasicWeakPtr(const BasicWeakPtr<U, Policy>& other) : Base(other.GetBlock(), other.GetPtr()) {
+        Base::Acquire(this->GetBlock());
+    }
+
+    // Demote `SharedPtr`
+    // #2 from https://en.cppreference.com/w/cpp/memory/weak_ptr/weak_ptr
+    template <typename U>
+    BasicWeakPtr(const BasicSharedPtr<U, Policy>& other) : Base(other.GetBlock(), other.GetPtr()) {
+        Base::Acquire(this->GetBlock());
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    void Reset() {
+        BasicWeakPtr().Swap(*this);
+    }
+
+    // Forgets the block without releasing it
+    void MakeNull() {
+        this->SetBlock(nullptr);
+        this->SetPtr(nullptr);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    size_t UseCount() const {
+        if (Block* block = this->GetBlock()) {
+            return static_cast<size_t>(block->GetStrongCount());
+        }
+        return 0;
+    }
+
+    bool Expired() const {
+        return UseCount() == 0;
+    }
+
+    // The counts `Lock` looks at
+    void PrefetchTarget() const {
+        PrefetchRead(this->GetBlock());
+    }
+
+    // Empty if the object is gone
+    BasicSharedPtr<T, Policy> TryLock() const noexcept {
+        Block* block = this->GetBlock();
+        if (block && block->StrongIncIfNonZero()) {
+            return BasicSharedPtr<T, Policy>(this->GetPtr(), block);
+        }
+        return BasicSharedPtr<T, Policy>();
+    }
+
+    BasicSharedPtr<T, Policy> Lock() const noexcept {
+        return TryLock();
+    }
+};
+
+template <typename T, typename Policy>
+struct IsTriviallyRelocatable<BasicWeakPtr<T, Policy>> : std::true_type {};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// EnableSharedFromThis
+
+// The weak self-reference is set when the object is first owned by a SharedPtr. It is a single
+// pointer to the control block: the object pointer is `this` cast back to T. A virtual base
+// cannot be cast back, so then the pointer is to a separately allocated WeakPtr instead.
+template <typename T, typename Policy>
+class BasicEnableSharedFromThis {
+    static_assert(Policy::kSharedFromThis, "this configuration does not link SharedFromThis");
+
+    template <typename Y, typename P>
+    friend class BasicSharedPtr;
+
+    using Block = SharedBlock<Policy>;
+
+public:
+    // Throws BadWeakPtr if the object is not owned by a SharedPtr
+    BasicSharedPtr<T, Policy> SharedFromThis() {
+        BasicSharedPtr<T, Policy> result = TrySharedFromThis();
+        if (!result) {
+            ThrowBadWeakPtr();
+        }
+        return result;
+    }
+
+    BasicSharedPtr<const T, Policy> SharedFromThis() const {
+        BasicSharedPtr<const T, Policy> result = TrySharedFromThis();
+        if (!result) {
+            ThrowBadWeakPtr();
+        }
+        return result;
+    }
+
+    // Empty if the object is not owned by a SharedPtr
+    BasicSharedPtr<T, Policy> TrySharedFromThis() noexcept {
+        return Promote(Self());
+    }
+
+    BasicSharedPtr<const T, Policy> TrySharedFromThis() const noexcept {
+        return Promote(Self());
+    }
+
+    BasicWeakPtr<T, Policy> WeakFromThis() noexcept {
+        return Demote(Self());
+    }
+
+    BasicWeakPtr<const T, Policy> WeakFromThis() const noexcept {
+        return Demote(Self());
+    }
+
+protected:
+    BasicEnableSharedFromThis() = default;
+
+    // Copies are separate objects with owners of their own
+    BasicEnableSharedFromThis(const BasicEnableSharedFromThis&) {
+    }
+
+    BasicEnableSharedFromThis& operator=(const BasicEnableSharedFromThis&) {
+        return *this;
+    }
+
+    ~BasicEnableSharedFromThis() {
+        if constexpr (IsDirect()) {
+            if (block_) {
+                block_->WeakRelease();
+            }
+        } else {
+            delete weak_;
+        }
+    }
+
+private:
+    // Whether `this` casts back to T. Asked only where T is complete, the layout cannot depend
+    // on it.
+    static constexpr bool IsDirect() {
+        return requires(BasicEnableSharedFromThis* base) { static_cast<T*>(base); };
+    }
+
+    T* Self() {
+        if constexpr (IsDirect()) {
+            return static_cast<T*>(this);
+        } else {
+            return weak_ ? weak_->GetPtr() : nullptr;
+        }
+    }
+
+    const T* Self() const {
+        return const_cast<BasicEnableSharedFromThis*>(this)->Self();
+    }
+
+    Block* GetBlock() const {
+        if constexpr (IsDirect()) {
+            return block_;
+        } else {
+            return weak_ ? weak_->GetBlock() : nullptr;
+        }
+    }
+
+    template <typename U>
+    BasicSharedPtr<U, Policy> Promote(U* self) const {
+        Block* block = GetBlock();
+        if (block && block->StrongIncIfNonZero()) {
+            return BasicSharedPtr<U, Policy>(self, block);
+        }
+        return BasicSharedPtr<U, Policy>();
+    }
+
+    template <typename U>
+    BasicWeakPtr<U, Policy> Demote(U* self) const {
+        BasicWeakPtr<U, Policy> result;
+        if (Block* block = GetBlock()) {
+            block->WeakInc();
+            result.SetBlock(block);
+            result.SetPtr(self);
+        }
+        return result;
+    }
+
+    // Called by every new owner; the first one links, or the next one after all owners are gone
+    void Link(Block* block, [[maybe_unused]] T* self) const {
+        Block* linked = GetBlock();
+        if (linked && linked->GetStrongCount() != 0) {
+            return;
+        }
+        block->WeakInc();
+        if constexpr (IsDirect()) {
+            if (linked) {
+                linked->WeakRelease();
+            }
+            block_ = block;
+        } else {
+            if (!weak_) {
+                weak_ = new BasicWeakPtr<T, Policy>;
+            }
+            BasicWeakPtr<T, Policy> linked_weak;
+            linked_weak.SetBlock(block);
+            linked_weak.SetPtr(self);
+            *weak_ = std::move(linked_weak);
+        }
+    }
+
+    // A weak reference; which member is in use is fixed by IsDirect()
+    union {
+        mutable Block* block_ = nullptr;
+        mutable BasicWeakPtr<T, Policy>* weak_;
+    };
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdlib>
+#include <exception>
+
+// Instead of std::bad_weak_ptr
+class BadWeakPtr : public std::exception {};
+
+// Build with -DSMART_PTR_NO_EXCEPTIONS (and -fno-exceptions) to compile the smart pointers
+// without exceptions: the promotions that would throw BadWeakPtr abort instead. `TryLock` and
+// `TrySharedFromThis` never throw, so code that has to handle expired objects uses them in
+// either configuration.
+[[noreturn]] inline void ThrowBadWeakPtr() {
+#ifdef SMART_PTR_NO_EXCEPTIONS
+    std::abort();
+#else
+    throw BadWeakPtr();
+#endif
+}
+
+// Policies, see shared_core.h
+class PlainCount;
+class AtomicCount;
+struct NoWeak;
+struct WithWeak;
+struct NoSharedFromThis;
+struct WithSharedFromThis;
+struct DefaultAllocation;
+struct ImmediateRelease;
+struct IterativeRelease;
+struct IncrementalRelease;
+
+// Bundle of policies a shared-ownership configuration is built from
+template <typename Count, typename Weak, typename SharedFromThis, typename Allocation,
+          typename Release = ImmediateRelease>
+struct SharedPolicy;
+
+template <typename T, typename Policy>
+class BasicSharedPtr;
+
+template <typename T, typename Policy>
+class BasicWeakPtr;
+
+template <typename T, typename Policy>
+class BasicEnableSharedFromThis;
+
+// From unique/unique.h; only needed when a UniquePtr is actually converted
+template <typename T, typename Deleter>
+class UniquePtr;
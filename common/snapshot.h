@@ -0,0 +1,351 @@
+#pragma once
+
+#include "shared_core.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>  // std::memcpy
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Binary snapshots of graphs of shared objects.
+//
+// A type takes part with
+//     void Save(SnapshotWriter& writer) const;   // writer.Write(field) for every field
+//     void Load(SnapshotReader& reader);         // reader.Read(field) in the same order
+// and a default constructor. Fields may be trivially copyable values, strings and SharedPtrs
+// to other such types. Every object is written once; later references to it are written as its
+// index, so sharing and cycles survive a round trip. Objects are saved and loaded breadth
+// first from a queue rather than recursively, so long chains do not grow the stack. An object
+// is restored into a default-constructed value before its fields are read, and `Load` may get
+// pointers to objects that are not loaded yet: it must only store them, not look into them.
+// A back-reference to an object restored as a different type is a SnapshotError.
+//
+// SharedPtrs must own the whole object of their static type (no aliasing, no pointers to a base).
+// Values are stored in the byte order of the machine that wrote them.
+
+// Malformed or truncated input, or a graph the format cannot express
+class SnapshotError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+namespace snapshot_format {
+
+inline constexpr char kMagic[8] = {'S', 'P', 'S', 'N', 'A', 'P', '0', '2'};
+// Header: magic, then the number of objects (the reader sizes its table from it)
+inline constexpr size_t kHeaderSize = sizeof(kMagic) + sizeof(uint64_t);
+// References: 0 is null, kNewObject is the next object in the queue, anything else is index + 1.
+// The queued objects follow the outermost reference, in the order they were reached.
+inline constexpr uint64_t kNull = 0;
+inline constexpr uint64_t kNewObject = ~uint64_t{0};
+
+}  // namespace snapshot_format
+
+class SnapshotWriter {
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    SnapshotWriter() : bytes_(snapshot_format::kHeaderSize) {
+        std::memcpy(bytes_.data(), snapshot_format::kMagic, sizeof(snapshot_format::kMagic));
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Writing
+
+    template <typename T>
+    void Write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>, "give the type Save/Load hooks");
+        WriteBytes(&value, sizeof(T));
+    }
+
+    void Write(const std::string& value) {
+        Write(static_cast<uint64_t>(value.size()));
+        WriteBytes(value.data(), value.size());
+    }
+
+    template <typename T, typename Policy>
+    void Write(const BasicSharedPtr<T, Policy>& ptr) {
+        if (!ptr) {
+            Write(snapshot_format::kNull);
+            return;
+        }
+        auto [it, inserted] = index_.try_emplace(ptr.GetBlock(), Seen{index_.size(), ptr.Get()});
+        if (!inserted) {
+            if (it->second.object != ptr.Get()) {
+                throw SnapshotError("two pointers into one control block");
+            }
+            Write(it->second.index + 1);
+            return;
+        }
+        Write(snapshot_format::kNewObject);
+        pending_.push_back({ptr.Get(), &SaveObject<T>});
+        SavePending();
+    }
+
+    void WriteBytes(const void* data, size_t size) {
+        const auto* begin = static_cast<const std::byte*>(data);
+        bytes_.insert(bytes_.end(), begin, begin + size);
+    }
+
+    // The snapshot; the writer is left empty
+    std::vector<std::byte> Finish() && {
+        uint64_t count = index_.size();
+        std::memcpy(bytes_.data() + sizeof(snapshot_format::kMagic), &count, sizeof(count));
+        index_.clear();
+        return std::move(bytes_);
+    }
+
+private:
+    struct Seen {
+        uint64_t index;
+        const void* object;
+    };
+
+    struct Pending {
+        const void* object;
+        void (*save)(const void* object, SnapshotWriter& writer);
+    };
+
+    template <typename T>
+    static void SaveObject(const void* object, SnapshotWriter& writer) {
+        static_cast<const T*>(object)->Save(writer);
+    }
+
+    // Saves the queued objects unless an outer call is doing it already
+    void SavePending() {
+        if (saving_) {
+            return;
+        }
+        saving_ = true;
+        try {
+            for (size_t i = 0; i < pending_.size(); ++i) {
+                pending_[i].save(pending_[i].object, *this);
+            }
+        } catch (...) {
+            saving_ = false;
+            pending_.clear();
+            throw;
+        }
+        saving_ = false;
+        pending_.clear();
+    }
+
+    std::vector<std::byte> bytes_;
+    std::unordered_map<const void*, Seen> index_;
+    std::vector<Pending> pending_;
+    bool saving_ = false;
+};
+
+class SnapshotReader {
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    // `bytes` must outlive the reader; a memory-mapped file works (see MappedSnapshot)
+    explicit SnapshotReader(std::span<const std::byte> bytes) : bytes_(bytes) {
+        if (bytes.size() < snapshot_format::kHeaderSize ||
+            std::memcmp(bytes.data(), snapshot_format::kMagic, sizeof(snapshot_format::kMagic))) {
+            throw SnapshotError("not a snapshot");
+        }
+        uint64_t count;
+        std::memcpy(&count, bytes.data() + sizeof(snapshot_format::kMagic), sizeof(count));
+        // Every object takes at least one byte
+        if (count > bytes.size()) {
+            throw SnapshotError("object count out of range");
+        }
+        objects_.reserve(count);
+        offset_ = snapshot_format::kHeaderSize;
+    }
+
+    SnapshotReader(const SnapshotReader&) = delete;
+    SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    // The reader holds a reference to every object it restored
+    ~SnapshotReader() {
+        for (const Restored& object : objects_) {
+            object.release(object.block);
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Reading
+
+    template <typename T>
+    void Read(T& value) {
+        static_assert(std::is_trivially_copyable_v<T>, "give the type Save/Load hooks");
+        ReadBytes(&value, sizeof(T));
+    }
+
+    void Read(std::string& value) {
+        uint64_t size;
+        Read(size);
+        if (size > bytes_.size() - offset_) {
+            throw SnapshotError("truncated snapshot");
+        }
+        value.assign(reinterpret_cast<const char*>(bytes_.data() + offset_), size);
+        offset_ += size;
+    }
+
+    template <typename T, typename Policy>
+    void Read(BasicSharedPtr<T, Policy>& ptr) {
+        using Block = SharedBlock<Policy>;
+
+        uint64_t ref;
+        Read(ref);
+        if (ref == snapshot_format::kNull) {
+            ptr.Reset();
+            return;
+        }
+        if (ref != snapshot_format::kNewObject) {
+            if (ref > objects_.size()) {
+                throw SnapshotError("reference to an unknown object");
+            }
+            const Restored& object = objects_[ref - 1];
+            if (object.type != TypeTag<T, Policy>()) {
+                throw SnapshotError("reference to an object of another type");
+            }
+            auto* block = static_cast<Block*>(object.block);
+            block->StrongInc();
+            ptr = BasicSharedPtr<T, Policy>(static_cast<T*>(object.object), block);
+            return;
+        }
+        if (objects_.size() == objects_.capacity()) {
+            throw SnapshotError("more objects than the header says");
+        }
+
+        auto result = MakeBasicShared<T, Policy>();
+        result.GetBlock()->StrongInc();
+        objects_.push_back(
+            {result.GetBlock(), result.Get(), TypeTag<T, Policy>(), &ReleaseBlock<Block>});
+        pending_.push_back({result.Get(), &LoadObject<T>});
+        ptr = std::move(result);
+        LoadPending();
+    }
+
+    void ReadBytes(void* data, size_t size) {
+        if (size > bytes_.size() - offset_) {
+            throw SnapshotError("truncated snapshot");
+        }
+        std::memcpy(data, bytes_.data() + offset_, size);
+        offset_ += size;
+    }
+
+    bool AtEnd() const {
+        return offset_ == bytes_.size();
+    }
+
+private:
+    struct Restored {
+        void* block;
+        void* object;
+        // What the object was restored as; back-references must ask for the same
+        const void* type;
+        void (*release)(void* block);
+    };
+
+    struct Pending {
+        void* object;
+        void (*load)(void* object, SnapshotReader& reader);
+    };
+
+    template <typename T, typename Policy>
+    static const void* TypeTag() {
+        static const char tag = 0;
+        return &tag;
+    }
+
+    template <typename Block>
+    static void ReleaseBlock(void* block) {
+        static_cast<Block*>(block)->StrongRelease();
+    }
+
+    template <typename T>
+    static void LoadObject(void* object, SnapshotReader& reader) {
+        static_cast<T*>(object)->Load(reader);
+    }
+
+    // Loads the queued objects unless an outer call is doing it already
+    void LoadPending() {
+        if (loading_) {
+            return;
+        }
+        loading_ = true;
+        try {
+            for (size_t i = 0; i < pending_.size(); ++i) {
+                pending_[i].load(pending_[i].object, *this);
+            }
+        } catch (...) {
+            loading_ = false;
+            pending_.clear();
+            throw;
+        }
+        loading_ = false;
+        pending_.clear();
+    }
+
+    std::span<const std::byte> bytes_;
+    size_t offset_;
+    std::vector<Restored> objects_;
+    std::vector<Pending> pending_;
+    bool loading_ = false;
+};
+
+#if __has_include(<sys/mman.h>)
+
+// A snapshot file mapped into memory, so that restoring reads it straight from the page cache
+class MappedSnapshot {
+public:
+    explicit MappedSnapshot(const char* path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            throw SnapshotError(std::string("cannot open ") + path);
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            close(fd);
+            throw SnapshotError(std::string("cannot read ") + path);
+        }
+        size_ = static_cast<size_t>(info.st_size);
+        data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data_ == MAP_FAILED) {
+            throw SnapshotError(std::string("cannot map ") + path);
+        }
+        // Restoring reads the file front to back
+        madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+
+    MappedSnapshot(const MappedSnapshot&) = delete;
+    MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+
+    ~MappedSnapshot() {
+        munmap(data_, size_);
+    }
+
+    std::span<const std::byte> Bytes() const {
+        return {static_cast<const std::byte*>(data_), size_};
+    }
+
+private:
+    void* data_;
+    size_t size_;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>  // std::nullptr_t, std::ptrdiff_t
+#include <cstdint>  // std::uintptr_t
+#include <type_traits>
+
+// Pointer stored as the distance from its own address, so that a structure linked by OffsetPtrs
+// stays valid when the memory holding it is mapped at another address (in another process).
+// Both the pointer and its target must be in the same mapping.
+// Offset 1 means null: no T can start one byte after a pointer that points to it.
+// Not trivially relocatable: a byte copy elsewhere points somewhere else.
+template <typename T>
+class OffsetPtr {
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    OffsetPtr() : offset_(kNull) {
+    }
+
+    OffsetPtr(std::nullptr_t) : offset_(kNull) {
+    }
+
+    OffsetPtr(T* ptr) : offset_(OffsetTo(ptr)) {
+    }
+
+    // The distance changes with the address of the copy
+    OffsetPtr(const OffsetPtr& other) : offset_(OffsetTo(other.Get())) {
+    }
+
+    template <typename Y, typename = std::enable_if_t<std::is_convertible_v<Y*, T*>>>
+    OffsetPtr(const OffsetPtr<Y>& other) : offset_(OffsetTo(other.Get())) {
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+
+    OffsetPtr& operator=(const OffsetPtr& other) {
+        offset_ = OffsetTo(other.Get());
+        return *this;
+    }
+
+    OffsetPtr& operator=(T* ptr) {
+        offset_ = OffsetTo(ptr);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    T* Get() const {
+        if (offset_ == kNull) {
+            return nullptr;
+        }
+        return reinterpret_cast<T*>(reinterpret_cast<std::uintptr_t>(this) + offset_);
+    }
+
+    T& operator*() const {
+        return *Get();
+    }
+
+    T* operator->() const {
+        return Get();
+    }
+
+    explicit operator bool() const {
+        return offset_ != kNull;
+    }
+
+    friend bool operator==(const OffsetPtr& left, const OffsetPtr& right) {
+        return left.Get() == right.Get();
+    }
+
+private:
+    static constexpr std::ptrdiff_t kNull = 1;
+
+    std::ptrdiff_t OffsetTo(T* ptr) const {
+        if (!ptr) {
+            return kNull;
+        }
+        return static_cast<std::ptrdiff_t>(reinterpret_cast<std::uintptr_t>(ptr) -
+                                           reinterpret_cast<std::uintptr_t>(this));
+    }
+
+    std::ptrdiff_t offset_;
+};
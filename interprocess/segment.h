@@ -0,0 +1,309 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <new>  // std::bad_alloc
+#include <stdexcept>
+#include <system_error>
+#include <thread>  // std::this_thread::yield
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Shared memory segments with an allocator whose state lives in the segment itself.
+// The segment may be mapped at a different address in every process, so everything inside
+// refers to everything else by offset (see OffsetPtr).
+
+// The first bytes of every segment
+class SegmentHeader {
+public:
+    static constexpr size_t kAlignment = 16;
+
+    explicit SegmentHeader(size_t size) : size_(size), top_(Round(sizeof(SegmentHeader))) {
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Allocation
+
+    // Returns kAlignment-aligned memory; throws std::bad_alloc when the segment is full
+    void* Allocate(size_t size) {
+        // Checked before the addition, which could otherwise wrap
+        if (size > kMaxChunk - sizeof(Chunk)) {
+            throw std::bad_alloc();
+        }
+        size_t size_class = SizeClass(size + sizeof(Chunk));
+        Guard guard(*this);
+        uint64_t offset = free_[size_class];
+        if (offset != 0) {
+            free_[size_class] = At(offset)->next_free;
+        } else {
+            uint64_t chunk_size = uint64_t{1} << size_class;
+            if (chunk_size > size_ - top_) {
+                throw std::bad_alloc();
+            }
+            offset = top_;
+            top_ += chunk_size;
+        }
+        Chunk* chunk = At(offset);
+        chunk->size_class = size_class;
+        in_use_ += uint64_t{1} << size_class;
+        return chunk + 1;
+    }
+
+    void Deallocate(void* ptr) {
+        Chunk* chunk = static_cast<Chunk*>(ptr) - 1;
+        Guard guard(*this);
+        in_use_ -= uint64_t{1} << chunk->size_class;
+        chunk->next_free = free_[chunk->size_class];
+        free_[chunk->size_class] = OffsetOf(chunk);
+    }
+
+    // Bytes in allocated chunks, headers included
+    size_t BytesInUse() const {
+        Guard guard(const_cast<SegmentHeader&>(*this));
+        return in_use_;
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+    // The smallest segment that holds the header
+    static constexpr size_t MinSize() {
+        return Round(sizeof(SegmentHeader));
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Root object
+
+    // Offset of the object other processes start from, 0 if there is none
+    uint64_t RootOffset() const {
+        return root_.load(std::memory_order_acquire);
+    }
+
+    void SetRootOffset(uint64_t offset) {
+        uint64_t expected = 0;
+        if (!root_.compare_exchange_strong(expected, offset, std::memory_order_release)) {
+            throw std::logic_error("the segment already has a root");
+        }
+    }
+
+    void* FromOffset(uint64_t offset) {
+        return reinterpret_cast<std::byte*>(this) + offset;
+    }
+
+    uint64_t OffsetOf(const void* ptr) const {
+        return static_cast<const std::byte*>(ptr) - reinterpret_cast<const std::byte*>(this);
+    }
+
+    bool Valid() const {
+        return magic_ == kMagic;
+    }
+
+private:
+    static constexpr uint64_t kMagic = 0x73686d5f73656731;  // "shm_seg1"
+    static constexpr size_t kMinClass = 5;                  // 32-byte chunks
+    static constexpr size_t kClasses = 64;
+    static constexpr uint64_t kMaxChunk = uint64_t{1} << (kClasses - 1);
+
+    struct alignas(kAlignment) Chunk {
+        uint64_t size_class;
+        uint64_t next_free;
+    };
+
+    // A spin lock works across processes as long as the atomic is lock-free
+    class Guard {
+    public:
+        explicit Guard(SegmentHeader& header) : lock_(header.lock_) {
+            while (lock_.exchange(1, std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+
+        ~Guard() {
+            lock_.store(0, std::memory_order_release);
+        }
+
+    private:
+        std::atomic<uint32_t>& lock_;
+    };
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free);
+    static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+    static constexpr uint64_t Round(uint64_t size) {
+        return (size + kAlignment - 1) / kAlignment * kAlignment;
+    }
+
+    static size_t SizeClass(size_t size) {
+        size_t size_class = kMinClass;
+        while ((uint64_t{1} << size_class) < size) {
+            ++size_class;
+        }
+        return size_class;
+    }
+
+    Chunk* At(uint64_t offset) {
+        return static_cast<Chunk*>(FromOffset(offset));
+    }
+
+    uint64_t magic_ = kMagic;
+    uint64_t size_;
+    std::atomic<uint32_t> lock_ = 0;
+    uint64_t top_;
+    uint64_t in_use_ = 0;
+    uint64_t free_[kClasses] = {};
+    std::atomic<uint64_t> root_ = 0;
+};
+
+// A process's mapping of a segment
+class SharedSegment {
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    // A new anonymous segment (memfd); other processes map it with `Open(Fd())`, which works
+    // after fork or once the descriptor has been passed over a Unix socket
+    explicit SharedSegment(size_t size)
+        : SharedSegment(memfd_create("shared_segment", MFD_CLOEXEC), "memfd_create") {
+        Create(size);
+    }
+
+    // A new segment with a name in /dev/shm
+    static SharedSegment CreateNamed(const char* name, size_t size) {
+        CheckSize(size);  // before the name exists
+        SharedSegment segment(shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600), "shm_open");
+        segment.Create(size);
+        return segment;
+    }
+
+    static SharedSegment OpenNamed(const char* name) {
+        SharedSegment segment(shm_open(name, O_RDWR, 0), "shm_open");
+        segment.Map();
+        return segment;
+    }
+
+    static SharedSegment Open(int fd) {
+        SharedSegment segment(dup(fd), "dup");
+        segment.Map();
+        return segment;
+    }
+
+    SharedSegment(SharedSegment&& other)
+        : fd_(std::exchange(other.fd_, -1)),
+          header_(std::exchange(other.header_, nullptr)),
+          size_(other.size_) {
+    }
+
+    SharedSegment(const SharedSegment&) = delete;
+    SharedSegment& operator=(const SharedSegment&) = delete;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    // Unmaps the segment; the memory goes away with the last mapping and descriptor
+    ~SharedSegment() {
+        if (header_) {
+            munmap(header_, size_);
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    SegmentHeader& Header() const {
+        return *header_;
+    }
+
+    int Fd() const {
+        return fd_;
+    }
+
+    bool Contains(const void* ptr) const {
+        auto* begin = reinterpret_cast<const std::byte*>(header_);
+        return begin <= ptr && ptr < begin + size_;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Root object
+
+    // Creates the object other processes find with `Root<T>()`; at most one per segment
+    template <typename T, typename... Args>
+    T& CreateRoot(Args&&... args) {
+        static_assert(alignof(T) <= SegmentHeader::kAlignment);
+        void* storage = header_->Allocate(sizeof(T));
+        T* root;
+        try {
+            root = new (storage) T(std::forward<Args>(args)...);
+        } catch (...) {
+            header_->Deallocate(storage);
+            throw;
+        }
+        header_->SetRootOffset(header_->OffsetOf(root));
+        return *root;
+    }
+
+    template <typename T>
+    T& Root() const {
+        uint64_t offset = header_->RootOffset();
+        if (offset == 0) {
+            throw std::logic_error("the segment has no root");
+        }
+        return *static_cast<T*>(header_->FromOffset(offset));
+    }
+
+private:
+    SharedSegment(int fd, const char* what) : fd_(fd) {
+        if (fd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), what);
+        }
+    }
+
+    // Smaller segments would not even hold the header
+    static void CheckSize(size_t size) {
+        if (size < SegmentHeader::MinSize()) {
+            throw std::invalid_argument("the segment is smaller than its header");
+        }
+    }
+
+    void Create(size_t size) {
+        CheckSize(size);
+        if (ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+            throw std::system_error(errno, std::generic_category(), "ftruncate");
+        }
+        MapBytes(size);
+        new (header_) SegmentHeader(size);
+    }
+
+    void Map() {
+        struct stat info;
+        if (fstat(fd_, &info) != 0) {
+            throw std::system_error(errno, std::generic_category(), "fstat");
+        }
+        MapBytes(static_cast<size_t>(info.st_size));
+        if (size_ < sizeof(SegmentHeader) || !header_->Valid()) {
+            throw std::runtime_error("not a shared segment");
+        }
+    }
+
+    void MapBytes(size_t size) {
+        void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (address == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "mmap");
+        }
+        header_ = static_cast<SegmentHeader*>(address);
+        size_ = size;
+    }
+
+    int fd_;
+    SegmentHeader* header_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "offset_ptr.h"
+#include "segment.h"
+
+#include <common/prefetch.h>
+
+#include <atomic>
+#include <cstddef>  // std::nullptr_t
+#include <cstdint>
+#include <new>
+#include <utility>
+
+// SharedPtr for objects in a shared segment. The count lives next to the object, in the
+// segment, so a pointer stored in the segment (or copied out of it) in one process keeps the
+// object alive for all of them. The last owner, in whichever process, destroys the object and
+// returns its memory to the segment.
+//
+// T itself must be usable from every process: no absolute pointers (use OffsetPtr and
+// ShmSharedPtr), no heap memory of one process, and no virtual functions unless every
+// process runs the same binary at the same address (e.g. after fork).
+
+template <typename T>
+class ShmSharedPtr;
+
+template <typename T, typename... Args>
+ShmSharedPtr<T> MakeShmShared(SharedSegment& segment, Args&&... args);
+
+// Count, segment and object in one chunk of the segment
+template <typename T>
+class ShmBlock {
+public:
+    template <typename... Args>
+    explicit ShmBlock(SegmentHeader* segment, Args&&... args)
+        : segment_(segment), value_(std::forward<Args>(args)...) {
+    }
+
+    void StrongInc() {
+        strong_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void StrongRelease() {
+        if (strong_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            SegmentHeader* segment = segment_.Get();
+            this->~ShmBlock();
+            segment->Deallocate(this);
+        }
+    }
+
+    int64_t GetStrongCount() const {
+        return strong_.load(std::memory_order_relaxed);
+    }
+
+    T* Get() {
+        return &value_;
+    }
+
+private:
+    static_assert(std::atomic<int64_t>::is_always_lock_free);
+
+    std::atomic<int64_t> strong_ = 1;
+    OffsetPtr<SegmentHeader> segment_;
+    T value_;
+};
+
+template <typename T>
+class ShmSharedPtr {
+    template <typename Y, typename... Args>
+    friend ShmSharedPtr<Y> MakeShmShared(SharedSegment& segment, Args&&... args);
+
+    using Block = ShmBlock<T>;
+
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    ShmSharedPtr() = default;
+
+    ShmSharedPtr(std::nullptr_t) {
+    }
+
+    ShmSharedPtr(const ShmSharedPtr& other) : block_(other.block_) {
+        if (block_) {
+            block_->StrongInc();
+        }
+    }
+
+    ShmSharedPtr(ShmSharedPtr&& other) : block_(other.block_) {
+        other.block_ = nullptr;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+
+    ShmSharedPtr& operator=(const ShmSharedPtr& other) {
+        ShmSharedPtr(other).Swap(*this);
+        return *this;
+    }
+
+    ShmSharedPtr& operator=(ShmSharedPtr&& other) {
+        ShmSharedPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    ~ShmSharedPtr() {
+        Reset();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    void Reset() {
+        if (Block* block = block_.Get()) {
+            block_ = nullptr;
+            block->StrongRelease();
+        }
+    }
+
+    void Swap(ShmSharedPtr& other) {
+        Block* block = block_.Get();
+        block_ = other.block_;
+        other.block_ = block;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    T* Get() const {
+        if (Block* block = block_.Get()) {
+            return block->Get();
+        }
+        return nullptr;
+    }
+
+    T& operator*() const {
+        return *Get();
+    }
+
+    T* operator->() const {
+        return Get();
+    }
+
+    size_t UseCount() const {
+        if (Block* block = block_.Get()) {
+            return static_cast<size_t>(block->GetStrongCount());
+        }
+        return 0;
+    }
+
+    explicit operator bool() const {
+        return static_cast<bool>(block_);
+    }
+
+    // The object and the count are in the same block
+    void PrefetchTarget() const {
+        PrefetchRead(block_.Get());
+    }
+
+    void PrefetchCounts() const {
+        PrefetchWrite(block_.Get());
+    }
+
+    friend bool operator==(const ShmSharedPtr& left, const ShmSharedPtr& right) {
+        return left.Get() == right.Get();
+    }
+
+private:
+    OffsetPtr<Block> block_;
+};
+
+// Creates the object in `segment`; throws std::bad_alloc when the segment is full
+template <typename T, typename... Args>
+ShmSharedPtr<T> MakeShmShared(SharedSegment& segment, Args&&... args) {
+    static_assert(alignof(ShmBlock<T>) <= SegmentHeader::kAlignment);
+    SegmentHeader* header = &segment.Header();
+    void* storage = header->Allocate(sizeof(ShmBlock<T>));
+    ShmSharedPtr<T> result;
+    try {
+        result.block_ = new (storage) ShmBlock<T>(header, std::forward<Args>(args)...);
+    } catch (...) {
+        header->Deallocate(storage);
+        throw;
+    }
+    return result;
+}
@@ -0,0 +1,187 @@
+#include "offset_ptr.h"
+#include "segment.h"
+#include "shm_shared.h"
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("OffsetPtr") {
+    struct Node {
+        int value = 0;
+        OffsetPtr<Node> next;
+    };
+
+    std::vector<Node> nodes(3);
+    for (int i = 0; i < 3; ++i) {
+        nodes[i].value = i;
+        nodes[i].next = &nodes[(i + 1) % 3];
+    }
+    REQUIRE(nodes[2].next->next->value == 1);
+
+    OffsetPtr<Node> copy = nodes[0].next;
+    REQUIRE(copy.Get() == &nodes[1]);
+    REQUIRE(copy == nodes[0].next);
+
+    OffsetPtr<Node> null;
+    REQUIRE(!null);
+    REQUIRE(null.Get() == nullptr);
+    copy = nullptr;
+    REQUIRE(copy == null);
+
+    // Pointing to its own address is not null
+    struct Self {
+        OffsetPtr<Self> self;
+    } self;
+    self.self = &self;
+    REQUIRE(self.self.Get() == &self);
+}
+
+TEST_CASE("Segment allocator") {
+    SharedSegment segment(1 << 16);
+    SegmentHeader& header = segment.Header();
+    REQUIRE(header.BytesInUse() == 0);
+
+    void* a = header.Allocate(10);
+    void* b = header.Allocate(1000);
+    REQUIRE(segment.Contains(a));
+    REQUIRE(segment.Contains(b));
+    REQUIRE(reinterpret_cast<uintptr_t>(a) % SegmentHeader::kAlignment == 0);
+
+    header.Deallocate(a);
+    REQUIRE(header.Allocate(12) == a);
+    REQUIRE_THROWS_AS(header.Allocate(1 << 16), std::bad_alloc);
+    // Sizes past the largest class must neither wrap nor index past the free lists
+    REQUIRE_THROWS_AS(header.Allocate(SIZE_MAX), std::bad_alloc);
+    REQUIRE_THROWS_AS(header.Allocate(SIZE_MAX / 2), std::bad_alloc);
+    REQUIRE(header.BytesInUse() == 32 + 1024);
+
+    header.Deallocate(a);
+    header.Deallocate(b);
+    REQUIRE(header.BytesInUse() == 0);
+}
+
+TEST_CASE("Segment too small for its header") {
+    REQUIRE_THROWS_AS(SharedSegment(0), std::invalid_argument);
+    REQUIRE_THROWS_AS(SharedSegment(SegmentHeader::MinSize() - 1), std::invalid_argument);
+    SharedSegment smallest(SegmentHeader::MinSize());
+    REQUIRE_THROWS_AS(smallest.Header().Allocate(1), std::bad_alloc);
+}
+
+TEST_CASE("Named segments") {
+    std::string name = "/smart_pointers_test_" + std::to_string(getpid());
+    SharedSegment created = SharedSegment::CreateNamed(name.c_str(), 1 << 12);
+    created.CreateRoot<int>(42);
+    REQUIRE_THROWS_AS(SharedSegment::CreateNamed(name.c_str(), 1 << 12), std::system_error);
+    std::string small = name + "_small";
+    REQUIRE_THROWS_AS(SharedSegment::CreateNamed(small.c_str(), 64), std::invalid_argument);
+    REQUIRE_THROWS_AS(SharedSegment::OpenNamed(small.c_str()), std::system_error);
+
+    SharedSegment opened = SharedSegment::OpenNamed(name.c_str());
+    shm_unlink(name.c_str());
+    REQUIRE(&opened.Root<int>() != &created.Root<int>());
+    REQUIRE(opened.Root<int>() == 42);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct Stats {
+    std::atomic<int> destroyed = 0;
+};
+
+struct Dataset {
+    static constexpr int kWorkers = 4;
+
+    Dataset(ShmSharedPtr<Stats> stats, int seed) : stats(std::move(stats)) {
+        for (int i = 0; i < 64; ++i) {
+            values[i] = seed + i;
+        }
+    }
+
+    ~Dataset() {
+        stats->destroyed.fetch_add(1);
+    }
+
+    int Sum() const {
+        int sum = 0;
+        for (int value : values) {
+            sum += value;
+        }
+        return sum;
+    }
+
+    int values[64];
+    std::atomic<int> readers = 0;
+    ShmSharedPtr<Stats> stats;
+    ShmSharedPtr<Dataset> results[kWorkers];
+};
+
+struct Root {
+    ShmSharedPtr<Stats> stats;
+    ShmSharedPtr<Dataset> dataset;
+};
+
+// Runs in a forked process, against its own mapping of the segment
+int Worker(int fd, int index) {
+    SharedSegment segment = SharedSegment::Open(fd);
+    Root& root = segment.Root<Root>();
+    ShmSharedPtr<Dataset> dataset = root.dataset;
+    if (!segment.Contains(dataset.Get()) || dataset->Sum() != 64 * 63 / 2) {
+        return 1;
+    }
+    dataset->readers.fetch_add(1);
+    dataset->results[index] = MakeShmShared<Dataset>(segment, dataset->stats, 1000 * index);
+    return dataset.UseCount() >= 2 ? 0 : 2;
+}
+
+TEST_CASE("ShmSharedPtr across processes") {
+    SharedSegment segment(1 << 20);
+    Root& root = segment.CreateRoot<Root>();
+    size_t empty_root = segment.Header().BytesInUse();
+    root.stats = MakeShmShared<Stats>(segment);
+    root.dataset = MakeShmShared<Dataset>(segment, root.stats, 0);
+    REQUIRE(root.stats.UseCount() == 2);
+
+    std::vector<pid_t> children;
+    for (int i = 0; i < Dataset::kWorkers; ++i) {
+        pid_t pid = fork();
+        REQUIRE(pid >= 0);
+        if (pid == 0) {
+            // No Catch in the child: report through the exit code only
+            _exit(Worker(segment.Fd(), i));
+        }
+        children.push_back(pid);
+    }
+    for (pid_t pid : children) {
+        int status;
+        REQUIRE(waitpid(pid, &status, 0) == pid);
+        REQUIRE(WIFEXITED(status));
+        REQUIRE(WEXITSTATUS(status) == 0);
+    }
+
+    // Every child dropped its copy on exit
+    REQUIRE(root.dataset.UseCount() == 1);
+    REQUIRE(root.dataset->readers == Dataset::kWorkers);
+    REQUIRE(root.stats.UseCount() == 2 + Dataset::kWorkers);
+    for (int i = 0; i < Dataset::kWorkers; ++i) {
+        const auto& result = root.dataset->results[i];
+        REQUIRE(result.UseCount() == 1);
+        REQUIRE(result->values[1] == 1000 * i + 1);
+    }
+
+    root.dataset.Reset();
+    REQUIRE(root.stats->destroyed == 1 + Dataset::kWorkers);
+    REQUIRE(root.stats.UseCount() == 1);
+
+    root.stats.Reset();
+    REQUIRE(segment.Header().BytesInUse() == empty_root);
+}
@@ -0,0 +1,262 @@
+#include "intrusive.h"
+#include "compressed.h"
+#include "hash_set.h"
+#include "list.h"
+
+#include <catch.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+constexpr size_t kNodes = 1 << 20;
+constexpr size_t kDegree = 16;
+
+struct BenchArenaTag;
+using BenchArena = VirtualArena<BenchArenaTag>;
+
+struct FullNode : public SimpleRefCounted<FullNode> {
+    uint64_t value = 0;
+};
+
+struct ArenaNode : public SimpleRefCounted<ArenaNode, ArenaDelete<BenchArena>> {
+    uint64_t value = 0;
+};
+
+// Adjacency lists stored back to back: node `v` owns edges [v * kDegree, (v + 1) * kDegree)
+template <typename Ptr, typename Make>
+std::vector<Ptr> BuildGraph(Make make) {
+    std::vector<Ptr> nodes;
+    nodes.reserve(kNodes);
+    for (size_t i = 0; i < kNodes; ++i) {
+        nodes.push_back(make());
+        nodes.back()->value = i;
+    }
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<size_t> pick(0, kNodes - 1);
+    std::vector<Ptr> edges;
+    edges.reserve(kNodes * kDegree);
+    for (size_t i = 0; i < kNodes * kDegree; ++i) {
+        edges.push_back(nodes[pick(gen)]);
+    }
+    return edges;
+}
+
+template <typename Ptr>
+uint64_t Traverse(const std::vector<Ptr>& edges) {
+    uint64_t sum = 0;
+    for (size_t v = 0; v < kNodes; ++v) {
+        for (size_t e = v * kDegree; e < (v + 1) * kDegree; ++e) {
+            sum += edges[e]->value;
+        }
+    }
+    return sum;
+}
+
+}  // namespace
+
+TEST_CASE("Compressed graph edges", "[!benchmark]") {
+    using FullPtr = IntrusivePtr<FullNode>;
+    using CompressedPtr = CompressedIntrusivePtr<ArenaNode, BenchArena>;
+
+    auto full = BuildGraph<FullPtr>([] { return MakeIntrusive<FullNode>(); });
+    auto compressed =
+        BuildGraph<CompressedPtr>([] { return MakeCompressedIntrusive<ArenaNode, BenchArena>(); });
+
+    WARN("IntrusivePtr edges: " << full.size() * sizeof(FullPtr) / (1 << 20) << " MB");
+    WARN("CompressedIntrusivePtr edges: " << compressed.size() * sizeof(CompressedPtr) / (1 << 20)
+                                          << " MB");
+    REQUIRE(Traverse(full) == Traverse(compressed));
+
+    BENCHMARK("IntrusivePtr traversal") {
+        return Traverse(full);
+    };
+
+    BENCHMARK("CompressedIntrusivePtr traversal") {
+        return Traverse(compressed);
+    };
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+constexpr int kSessions = 1 << 16;
+
+struct Session : public SimpleRefCounted<Session> {
+    explicit Session(int id) : id(id) {
+    }
+
+    int id;
+    uint64_t payload[4] = {};
+    ListHook lru;
+    SetHook by_id;
+};
+
+struct SessionHash {
+    using is_transparent = void;
+
+    size_t operator()(int id) const {
+        return std::hash<int>()(id);
+    }
+
+    size_t operator()(const Session& session) const {
+        return (*this)(session.id);
+    }
+
+    size_t operator()(const IntrusivePtr<Session>& session) const {
+        return (*this)(session->id);
+    }
+};
+
+struct SessionEqual {
+    using is_transparent = void;
+
+    template <typename L, typename R>
+    bool operator()(const L& left, const R& right) const {
+        return Id(left) == Id(right);
+    }
+
+    static int Id(int id) {
+        return id;
+    }
+
+    static int Id(const Session& session) {
+        return session.id;
+    }
+
+    static int Id(const IntrusivePtr<Session>& session) {
+        return session->id;
+    }
+};
+
+std::vector<IntrusivePtr<Session>> MakeSessions() {
+    std::vector<IntrusivePtr<Session>> sessions;
+    for (int i = 0; i < kSessions; ++i) {
+        sessions.push_back(MakeIntrusive<Session>(i));
+    }
+    // Heap order differs from list order, as it does after a while in a real LRU
+    std::shuffle(sessions.begin(), sessions.end(), std::mt19937(42));
+    return sessions;
+}
+
+}  // namespace
+
+TEST_CASE("Intrusive containers", "[!benchmark]") {
+    auto sessions = MakeSessions();
+
+    // Every step uses a random session, moves it to the back and reads the least recently
+    // used one
+    std::vector<int> touches;
+    std::mt19937 random(7);
+    for (int i = 0; i < 1'000'000; ++i) {
+        touches.push_back(random() % kSessions);
+    }
+
+    BENCHMARK_ADVANCED("64K LRU, 1M touches: std::list<IntrusivePtr>")(
+        Catch::Benchmark::Chronometer meter) {
+        std::list<IntrusivePtr<Session>> lru;
+        std::vector<std::list<IntrusivePtr<Session>>::iterator> positions(kSessions);
+        for (const auto& session : sessions) {
+            positions[session->id] = lru.insert(lru.end(), session);
+        }
+        meter.measure([&] {
+            uint64_t sum = 0;
+            for (int id : touches) {
+                auto position = positions[id];
+                sum += (*position)->payload[0];
+                lru.splice(lru.end(), lru, position);
+                sum += lru.front()->id;
+            }
+            return sum;
+        });
+    };
+
+    BENCHMARK_ADVANCED("64K LRU, 1M touches: IntrusiveList")(
+        Catch::Benchmark::Chronometer meter) {
+        IntrusiveList<Session, &Session::lru> lru;
+        std::vector<Session*> by_id(kSessions);
+        for (const auto& session : sessions) {
+            lru.PushBack(session);
+            by_id[session->id] = session.Get();
+        }
+        meter.measure([&] {
+            uint64_t sum = 0;
+            for (int id : touches) {
+                Session& session = *by_id[id];
+                sum += session.payload[0];
+                lru.Splice(lru.end(), lru, session);
+                sum += lru.Front().id;
+            }
+            return sum;
+        });
+    };
+
+    // A per-connection queue: 1M messages created, queued, consumed and dropped
+    BENCHMARK("64-deep queue, 1M messages: std::list<IntrusivePtr>") {
+        std::list<IntrusivePtr<Session>> queue;
+        uint64_t sum = 0;
+        for (int i = 0; i < 1'000'000; ++i) {
+            queue.push_back(MakeIntrusive<Session>(i));
+            if (queue.size() > 64) {
+                sum += queue.front()->id;
+                queue.pop_front();
+            }
+        }
+        return sum;
+    };
+
+    BENCHMARK("64-deep queue, 1M messages: IntrusiveList") {
+        IntrusiveList<Session, &Session::lru> queue;
+        uint64_t sum = 0;
+        for (int i = 0; i < 1'000'000; ++i) {
+            queue.PushBack(MakeIntrusive<Session>(i));
+            if (queue.Size() > 64) {
+                sum += queue.Front().id;
+                queue.PopFront();
+            }
+        }
+        return sum;
+    };
+
+    // Inserts every session, looks each one up and erases them all
+    BENCHMARK("64K set, insert/find/erase: std::unordered_set<IntrusivePtr>") {
+        std::unordered_set<IntrusivePtr<Session>, SessionHash, SessionEqual> set;
+        set.reserve(kSessions);
+        for (const auto& session : sessions) {
+            set.insert(session);
+        }
+        uint64_t sum = 0;
+        for (int id = 0; id < kSessions; ++id) {
+            sum += (*set.find(id))->id;
+        }
+        for (int id = 0; id < kSessions; ++id) {
+            set.erase(set.find(id));
+        }
+        return sum;
+    };
+
+    BENCHMARK("64K set, insert/find/erase: IntrusiveHashSet") {
+        IntrusiveHashSet<Session, &Session::by_id, SessionHash, SessionEqual> set(kSessions);
+        for (const auto& session : sessions) {
+            set.Insert(session);
+        }
+        uint64_t sum = 0;
+        for (int id = 0; id < kSessions; ++id) {
+            sum += set.Find(id)->id;
+        }
+        for (int id = 0; id < kSessions; ++id) {
+            set.Erase(*set.Find(id));
+        }
+        return sum;
+    };
+}
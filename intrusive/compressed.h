@@ -0,0 +1,257 @@
+#pragma once
+
+#include "intrusive.h"
+
+#include <sys/mman.h>
+
+#include <cassert>
+#include <cstddef>  // for std::nullptr_t
+#include <cstdint>
+#include <cstdlib>  // for std::abort
+#include <new>  // for std::bad_alloc
+#include <type_traits>
+#include <utility>  // for std::exchange / std::swap
+
+// Reserved virtual-memory region whose objects are addressed by 32-bit offsets scaled by
+// `1 << Shift`, i.e. up to 2^(32 + Shift) bytes. Pages are committed as the arena grows.
+// Freed blocks are kept in per-size free lists. Like SimpleCounter, the arena is not thread-safe.
+// `Tag` distinguishes independent arenas.
+template <typename Tag, size_t Shift = 3>
+class VirtualArena {
+public:
+    static constexpr size_t kShift = Shift;
+    static constexpr size_t kGranule = size_t{1} << Shift;
+    static constexpr size_t kReserved = (size_t{1} << 32) << Shift;
+    static constexpr size_t kMaxObjectSize = kGranule * 512;
+
+    static char* Base() {
+        return base_;
+    }
+
+    static void* Allocate(size_t size) {
+        // Larger sizes have no free list
+        if (size > kMaxObjectSize) {
+            OutOfMemory();
+        }
+        size_t granules = (size + kGranule - 1) / kGranule;
+        if (void* head = free_lists_[granules]) {
+            free_lists_[granules] = *static_cast<void**>(head);
+            return head;
+        }
+        size_t bytes = granules * kGranule;
+        if (kReserved - top_ < bytes) {
+            OutOfMemory();
+        }
+        if (top_ + bytes > committed_) {
+            Commit(top_ + bytes);
+        }
+        return base_ + std::exchange(top_, top_ + bytes);
+    }
+
+    static void Deallocate(void* ptr, size_t size) {
+        size_t granules = (size + kGranule - 1) / kGranule;
+        *static_cast<void**>(ptr) = free_lists_[granules];
+        free_lists_[granules] = ptr;
+    }
+
+    // Bytes handed out so far (including blocks sitting in the free lists)
+    static size_t Used() {
+        return top_;
+    }
+
+private:
+    static constexpr size_t kCommitStep = size_t{2} << 20;
+
+    // Aborts instead under SMART_PTR_NO_EXCEPTIONS, like ThrowBadWeakPtr
+    [[noreturn]] static void OutOfMemory() {
+#ifdef SMART_PTR_NO_EXCEPTIONS
+        std::abort();
+#else
+        throw std::bad_alloc();
+#endif
+    }
+
+    static char* Reserve() {
+        void* base = mmap(nullptr, kReserved, PROT_NONE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED) {
+            OutOfMemory();
+        }
+        return static_cast<char*>(base);
+    }
+
+    static void Commit(size_t up_to) {
+        size_t target = (up_to + kCommitStep - 1) / kCommitStep * kCommitStep;
+        if (target > kReserved) {
+            target = kReserved;
+        }
+        if (mprotect(base_ + committed_, target - committed_, PROT_READ | PROT_WRITE) != 0) {
+            OutOfMemory();
+        }
+        committed_ = target;
+    }
+
+    inline static char* const base_ = Reserve();
+    // Offset 0 is the null pointer, so the first granule is never handed out
+    inline static size_t top_ = kGranule;
+    inline static size_t committed_ = 0;
+    inline static void* free_lists_[kMaxObjectSize / kGranule + 1] = {};
+};
+
+// Deleter policy for RefCounted objects living in an arena
+template <typename Arena>
+struct ArenaDelete {
+    template <typename T>
+    static void Destroy(T* object) {
+        object->~T();
+        Arena::Deallocate(object, sizeof(T));
+    }
+};
+
+// IntrusivePtr to an object inside `Arena`, stored as a 32-bit scaled offset from the arena base
+template <typename T, typename Arena>
+class CompressedIntrusivePtr {
+    template <typename Y, typename A>
+    friend class CompressedIntrusivePtr;
+
+public:
+    // Constructors
+    CompressedIntrusivePtr() : offset_(0) {
+    }
+
+    CompressedIntrusivePtr(std::nullptr_t) : offset_(0) {
+    }
+
+    CompressedIntrusivePtr(T* ptr) : offset_(Compress(ptr)) {
+        if (ptr) {
+            ptr->IncRef();
+        }
+    }
+
+    // Only the conversions IntrusivePtr allows, i.e. no implicit downcasts
+    template <typename Y, typename = std::enable_if_t<std::is_convertible_v<Y*, T*>>>
+    CompressedIntrusivePtr(const CompressedIntrusivePtr<Y, Arena>& other)
+        : CompressedIntrusivePtr(other.Get()) {
+    }
+
+    CompressedIntrusivePtr(const CompressedIntrusivePtr& other) : offset_(other.offset_) {
+        if (offset_) {
+            Get()->IncRef();
+        }
+    }
+
+    CompressedIntrusivePtr(CompressedIntrusivePtr&& other)
+        : offset_(std::exchange(other.offset_, 0)) {
+    }
+
+    // `operator=`-s
+    CompressedIntrusivePtr& operator=(const CompressedIntrusivePtr& other) {
+        CompressedIntrusivePtr(other).Swap(*this);
+        return *this;
+    }
+
+    CompressedIntrusivePtr& operator=(CompressedIntrusivePtr&& other) {
+        CompressedIntrusivePtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    // Destructor
+    ~CompressedIntrusivePtr() {
+        Reset();
+    }
+
+    // Modifiers
+    void Reset() {
+        if (offset_) {
+            Get()->DecRef();
+            offset_ = 0;
+        }
+    }
+
+    void Reset(T* ptr) {
+        CompressedIntrusivePtr(ptr).Swap(*this);
+    }
+
+    void Swap(CompressedIntrusivePtr& other) {
+        std::swap(offset_, other.offset_);
+    }
+
+    // Observers
+    T* Get() const {
+        if (offset_) {
+            return Decompress(offset_);
+        }
+        return nullptr;
+    }
+
+    T& operator*() const {
+        return *Decompress(offset_);
+    }
+
+    T* operator->() const {
+        return Decompress(offset_);
+    }
+
+    size_t UseCount() const {
+        if (offset_) {
+            return Get()->RefCount();
+        }
+        return 0;
+    }
+
+    explicit operator bool() const {
+        return offset_ != 0;
+    }
+
+    void PrefetchTarget() const {
+        PrefetchRead(Get());
+    }
+
+    void PrefetchCounts() const {
+        PrefetchWrite(Get());
+    }
+
+    IntrusivePtr<T> ToIntrusive() const {
+        return IntrusivePtr<T>(Get());
+    }
+
+private:
+    static uint32_t Compress(T* ptr) {
+        if (!ptr) {
+            return 0;
+        }
+        auto delta = reinterpret_cast<char*>(ptr) - Arena::Base();
+        assert(delta > 0 && static_cast<size_t>(delta) < Arena::kReserved);
+        assert(delta % (ptrdiff_t{1} << Arena::kShift) == 0);
+        return static_cast<uint32_t>(static_cast<size_t>(delta) >> Arena::kShift);
+    }
+
+    static T* Decompress(uint32_t offset) {
+        size_t delta = static_cast<size_t>(offset) << Arena::kShift;
+        return reinterpret_cast<T*>(Arena::Base() + delta);
+    }
+
+    uint32_t offset_;
+};
+
+template <typename T, typename Arena>
+struct IsTriviallyRelocatable<CompressedIntrusivePtr<T, Arena>> : std::true_type {};
+
+template <typename T, typename Arena, typename... Args>
+CompressedIntrusivePtr<T, Arena> MakeCompressedIntrusive(Args&&... args) {
+    static_assert(alignof(T) <= Arena::kGranule, "arena granule is too small for T");
+    static_assert(sizeof(T) <= Arena::kMaxObjectSize, "T is too large for the arena");
+    void* storage = Arena::Allocate(sizeof(T));
+#ifdef SMART_PTR_NO_EXCEPTIONS
+    T* a = new (storage) T(std::forward<Args>(args)...);
+#else
+    T* a;
+    try {
+        a = new (storage) T(std::forward<Args>(args)...);
+    } catch (...) {
+        Arena::Deallocate(storage, sizeof(T));
+        throw;
+    }
+#endif
+    return CompressedIntrusivePtr<T, Arena>(a);
+}
@@ -0,0 +1,248 @@
+#pragma once
+
+#include "hooks.h"
+#include "intrusive.h"
+
+#include <cstddef>
+#include <functional>  // for std::hash / std::equal_to
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Hash set with separate chaining through the elements (`Hook` is the SetHook member used by
+// this set). Like IntrusiveList, it keeps one reference to every element.
+//
+// Insert and erase allocate nothing: the bucket array is only sized by the constructor and by
+// `Rehash`, never behind the caller's back, so a set that grows far beyond its bucket count
+// gets long chains. `Hash` and `Equal` take elements, and whatever key type `Find` is called
+// with.
+template <typename T, SetHook T::*Hook, typename Hash = std::hash<T>,
+          typename Equal = std::equal_to<>>
+class IntrusiveHashSet {
+    template <bool kConst>
+    class Iterator {
+        friend class IntrusiveHashSet;
+
+        template <bool>
+        friend class Iterator;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<kConst, const T*, T*>;
+        using reference = std::conditional_t<kConst, const T&, T&>;
+
+        Iterator() = default;
+
+        template <bool kOther, typename = std::enable_if_t<kConst && !kOther>>
+        Iterator(const Iterator<kOther>& other)
+            : bucket_(other.bucket_), end_(other.end_), hook_(other.hook_) {
+        }
+
+        reference operator*() const {
+            return *Owner(hook_);
+        }
+
+        pointer operator->() const {
+            return Owner(hook_);
+        }
+
+        Iterator& operator++() {
+            hook_ = hook_->next_;
+            if (!hook_) {
+                ++bucket_;
+                SkipEmpty();
+            }
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        friend bool operator==(const Iterator& left, const Iterator& right) {
+            return left.hook_ == right.hook_;
+        }
+
+    private:
+        Iterator(SetHook* const* bucket, SetHook* const* end) : bucket_(bucket), end_(end) {
+            SkipEmpty();
+        }
+
+        void SkipEmpty() {
+            while (bucket_ != end_ && !*bucket_) {
+                ++bucket_;
+            }
+            hook_ = bucket_ != end_ ? *bucket_ : nullptr;
+        }
+
+        SetHook* const* bucket_ = nullptr;
+        SetHook* const* end_ = nullptr;
+        SetHook* hook_ = nullptr;
+    };
+
+public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    // `buckets` is rounded up to a power of two
+    explicit IntrusiveHashSet(size_t buckets = 16, const Hash& hash = Hash(),
+                              const Equal& equal = Equal())
+        : buckets_(RoundUp(buckets)), hash_(hash), equal_(equal) {
+    }
+
+    IntrusiveHashSet(const IntrusiveHashSet&) = delete;
+    IntrusiveHashSet& operator=(const IntrusiveHashSet&) = delete;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    ~IntrusiveHashSet() {
+        Clear();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    // Returns false (and drops `element`) if an equal element is already in the set.
+    // `element` must not be null; throws std::logic_error if it is in a set on `Hook`.
+    bool Insert(IntrusivePtr<T> element) {
+        SetHook* hook = &(element.Get()->*Hook);
+        if (hook->IsLinked()) {
+            throw std::logic_error("the element is already in a set");
+        }
+        size_t hash = hash_(*element);
+        SetHook*& bucket = Bucket(hash);
+        for (SetHook* other = bucket; other; other = other->next_) {
+            if (other->hash_ == hash && equal_(*Owner(other), *element)) {
+                return false;
+            }
+        }
+        hook->hash_ = hash;
+        hook->next_ = bucket;
+        hook->linked_ = true;
+        bucket = hook;
+        element.Detach();
+        ++size_;
+        return true;
+    }
+
+    // Unlinks `element`, which must be in this set, and returns the reference the set held
+    IntrusivePtr<T> Erase(T& element) {
+        SetHook* hook = &(element.*Hook);
+        SetHook** link = &Bucket(hook->hash_);
+        while (*link != hook) {
+            link = &(*link)->next_;
+        }
+        *link = hook->next_;
+        hook->next_ = nullptr;
+        hook->linked_ = false;
+        --size_;
+        return IntrusivePtr<T>::Adopt(&element);
+    }
+
+    void Clear() {
+        for (SetHook*& bucket : buckets_) {
+            while (SetHook* hook = bucket) {
+                Erase(*Owner(hook));
+            }
+        }
+    }
+
+    // Redistributes the elements over `buckets` (rounded up to a power of two) buckets
+    void Rehash(size_t buckets) {
+        std::vector<SetHook*> old(RoundUp(buckets));
+        old.swap(buckets_);
+        for (SetHook* hook : old) {
+            while (hook) {
+                SetHook* next = hook->next_;
+                SetHook*& bucket = Bucket(hook->hash_);
+                hook->next_ = bucket;
+                bucket = hook;
+                hook = next;
+            }
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    // The element equal to `key`, nullptr if there is none
+    template <typename K>
+    T* Find(const K& key) const {
+        size_t hash = hash_(key);
+        for (SetHook* hook = Bucket(hash); hook; hook = hook->next_) {
+            if (hook->hash_ == hash && equal_(*Owner(hook), key)) {
+                return Owner(hook);
+            }
+        }
+        return nullptr;
+    }
+
+    template <typename K>
+    bool Contains(const K& key) const {
+        return Find(key) != nullptr;
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+    bool Empty() const {
+        return size_ == 0;
+    }
+
+    size_t BucketCount() const {
+        return buckets_.size();
+    }
+
+    iterator begin() {
+        return iterator(buckets_.data(), buckets_.data() + buckets_.size());
+    }
+
+    iterator end() {
+        return iterator();
+    }
+
+    const_iterator begin() const {
+        return const_iterator(buckets_.data(), buckets_.data() + buckets_.size());
+    }
+
+    const_iterator end() const {
+        return const_iterator();
+    }
+
+private:
+    static T* Owner(const SetHook* hook) {
+        return hook_detail::OwnerOf<T, SetHook, Hook>(hook);
+    }
+
+    static size_t RoundUp(size_t buckets) {
+        size_t result = 1;
+        while (result < buckets) {
+            result *= 2;
+        }
+        return result;
+    }
+
+    SetHook*& Bucket(size_t hash) {
+        return buckets_[hash & (buckets_.size() - 1)];
+    }
+
+    SetHook* Bucket(size_t hash) const {
+        return buckets_[hash & (buckets_.size() - 1)];
+    }
+
+    std::vector<SetHook*> buckets_;
+    size_t size_ = 0;
+    [[no_unique_address]] Hash hash_;
+    [[no_unique_address]] Equal equal_;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <bit>  // for std::bit_cast
+#include <cassert>
+#include <cstddef>
+
+// Links embedded in the elements of intrusive containers (see list.h and hash_set.h).
+// An element has one hook per container it can be in at the same time:
+//     struct Connection : public SimpleRefCounted<Connection> {
+//         ListHook lru;
+//         ListHook queue;
+//         SetHook by_id;
+//     };
+// The container holds one reference to every element in it, so an element can only be
+// destroyed once it is out of all of them.
+
+class ListHook;
+class SetHook;
+
+template <typename T, ListHook T::*Hook>
+class IntrusiveList;
+
+template <typename T, SetHook T::*Hook, typename Hash, typename Equal>
+class IntrusiveHashSet;
+
+class ListHook {
+    template <typename T, ListHook T::*Hook>
+    friend class IntrusiveList;
+
+public:
+    ListHook() = default;
+
+    // A copy of an element is in no list
+    ListHook(const ListHook&) {
+    }
+
+    ListHook& operator=(const ListHook&) {
+        return *this;
+    }
+
+    ~ListHook() {
+        assert(!IsLinked());
+    }
+
+    bool IsLinked() const {
+        return next_ != nullptr;
+    }
+
+private:
+    ListHook* prev_ = nullptr;
+    ListHook* next_ = nullptr;
+};
+
+class SetHook {
+    template <typename T, SetHook T::*Hook, typename Hash, typename Equal>
+    friend class IntrusiveHashSet;
+
+public:
+    SetHook() = default;
+
+    SetHook(const SetHook&) {
+    }
+
+    SetHook& operator=(const SetHook&) {
+        return *this;
+    }
+
+    ~SetHook() {
+        assert(!IsLinked());
+    }
+
+    bool IsLinked() const {
+        return linked_;
+    }
+
+private:
+    SetHook* next_ = nullptr;
+    size_t hash_ = 0;
+    bool linked_ = false;
+};
+
+namespace hook_detail {
+
+// The element that embeds `hook` as `Member`. `offsetof` takes a member name, not a pointer to
+// member, so the offset is read from `Member` itself: under the Itanium C++ ABI (GCC, Clang) a
+// pointer to data member holds the member's offset in bytes. No object is touched. A member of a
+// virtual base of T cannot be passed as `Hook T::*`, so virtual bases never move the offset; ABIs
+// with another representation fail the static_assert.
+template <typename T, typename Hook, Hook T::*Member>
+T* OwnerOf(const Hook* hook) {
+    static_assert(sizeof(Member) == sizeof(std::ptrdiff_t), "expects the Itanium C++ ABI");
+    const auto offset = std::bit_cast<std::ptrdiff_t>(Member);
+    return reinterpret_cast<T*>(
+        const_cast<std::byte*>(reinterpret_cast<const std::byte*>(hook)) - offset);
+}
+
+}  // namespace hook_detail
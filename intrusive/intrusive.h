@@ -1,7 +1,18 @@
 #pragma once
 
-#include <cstddef>  // for std::nullptr_t
-#include <utility>  // for std::exchange / std::swap
+#include <common/allocation.h>
+#include <common/bulk.h>
+#include <common/prefetch.h>
+#include <common/reclaim.h>
+#include <common/relocation.h>
+
+#include <atomic>       // for std::atomic
+#include <cstddef>      // for std::nullptr_t
+#include <cstdint>      // for uint16_t / uint32_t
+#include <cstdlib>      // for std::abort
+#include <limits>       // for std::numeric_limits
+#include <type_traits>  // for std::void_t
+#include <utility>      // for std::exchange / std::swap
 
 class SimpleCounter {
 public:
@@ -23,16 +34,181 @@ private:
     size_t count_ = 0;
 };
 
+// For objects shared between threads. The decrement that reaches zero synchronizes with
+// all earlier ones, so the deleter sees every write made through the other owners.
+class AtomicCounter {
+public:
+    size_t IncRef() {
+        return count_.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    size_t DecRef() {
+        return count_.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    }
+
+    // `n` references at once, for the bulk operations (see bulk.h)
+    size_t IncRef(size_t n) {
+        return count_.fetch_add(n, std::memory_order_relaxed) + n;
+    }
+
+    size_t DecRef(size_t n) {
+        return count_.fetch_sub(n, std::memory_order_acq_rel) - n;
+    }
+
+    size_t RefCount() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<size_t> count_ = 0;
+};
+
+// Overflow policies for NarrowCounter
+
+// The counter sticks at its maximum and the object becomes immortal (it is never destroyed).
+struct SaturateOnOverflow {
+    static constexpr bool kSticky = true;
+
+    static void Overflow() {
+    }
+};
+
+struct AbortOnOverflow {
+    static constexpr bool kSticky = false;
+
+    [[noreturn]] static void Overflow() {
+        std::abort();
+    }
+};
+
+// Counter stored in `UInt` for objects with few owners
+template <typename UInt, typename OverflowPolicy = SaturateOnOverflow>
+class NarrowCounter {
+    static_assert(std::is_unsigned_v<UInt>);
+
+public:
+    size_t IncRef() {
+        if (count_ == kMax) {
+            OverflowPolicy::Overflow();
+            return count_;
+        }
+        return ++count_;
+    }
+
+    size_t DecRef() {
+        if constexpr (OverflowPolicy::kSticky) {
+            if (count_ == kMax) {
+                return count_;
+            }
+        }
+        return --count_;
+    }
+
+    size_t RefCount() const {
+        return count_;
+    }
+
+private:
+    static constexpr UInt kMax = std::numeric_limits<UInt>::max();
+
+    UInt count_ = 0;
+};
+
 struct DefaultDelete {
     template <typename T>
     static void Destroy(T* object) {
-        delete object;
+        DeleteObject(object);
+    }
+};
+
+// Deleter policies that do not recurse: an object released while another one is being destroyed
+// on the same thread is queued (see common/reclaim.h), so long chains do not exhaust the stack.
+// With IncrementalDelete nothing is destroyed until IncrementalReclaimer::Local().Step() runs.
+template <typename Deleter = DefaultDelete>
+struct IterativeDelete {
+    template <typename T>
+    static void Destroy(T* object) {
+        IterativeReclaimer::Release(PendingRelease::Of<T, &Deleter::template Destroy<T>>(object));
+    }
+};
+
+template <typename Deleter = DefaultDelete>
+struct IncrementalDelete {
+    template <typename T>
+    static void Destroy(T* object) {
+        IncrementalReclaimer::Local().Push(
+            PendingRelease::Of<T, &Deleter::template Destroy<T>>(object));
+    }
+};
+
+// Per-thread cache of raw storage for objects of type T, at most N slots.
+// Once the cache of a thread is destroyed at thread exit, objects released later (with static or
+// thread storage duration) go straight back to the allocator.
+template <typename T, size_t N>
+class RecycleCache {
+public:
+    // Returns cached storage or nullptr.
+    static void* Take() {
+        RecycleCache* cache = Local();
+        if (!cache || cache->size_ == 0) {
+            return nullptr;
+        }
+        return cache->slots_[--cache->size_];
+    }
+
+    // Keeps `storage` for reuse; returns false when the cache is full or gone.
+    static bool Put(void* storage) {
+        RecycleCache* cache = Local();
+        if (!cache || cache->size_ == N) {
+            return false;
+        }
+        cache->slots_[cache->size_++] = storage;
+        return true;
+    }
+
+    ~RecycleCache() {
+        while (size_ > 0) {
+            Deallocate(slots_[--size_], sizeof(T), alignof(T));
+        }
+        destroyed_ = true;
+    }
+
+private:
+    static RecycleCache* Local() {
+        if (destroyed_) {
+            return nullptr;
+        }
+        thread_local RecycleCache cache;
+        return &cache;
+    }
+
+    static inline thread_local bool destroyed_ = false;
+
+    void* slots_[N];
+    size_t size_ = 0;
+};
+
+// Destroys the object and keeps its storage in the thread's RecycleCache,
+// so that MakeIntrusive can reuse it without going to the allocator.
+// The object must have been created by MakeIntrusive or plain `new T`, and Derived must be
+// its dynamic type.
+template <size_t N>
+struct RecycleDelete {
+    template <typename T>
+    static void Destroy(T* object) {
+        object->~T();
+        if (!RecycleCache<T, N>::Put(object)) {
+            Deallocate(object, sizeof(T), alignof(T));
+        }
     }
 };
 
 template <typename Derived, typename Counter, typename Deleter>
 class RefCounted {
 public:
+    using CounterType = Counter;
+    using DeleterType = Deleter;
+
     // Increase reference counter.
     void IncRef() {
         counter_.IncRef();
@@ -46,11 +222,28 @@ public:
         }
     }
 
+    // `n` references at once, for the bulk operations (see bulk.h)
+    void IncRef(size_t n) {
+        counter_.IncRef(n);
+    }
+
+    void DecRef(size_t n) {
+        if (counter_.DecRef(n) == 0) {
+            Deleter::Destroy(static_cast<Derived*>(this));
+        }
+    }
+
     // Get current counter value (the number of strong references).
     size_t RefCount() const {
         return counter_.RefCount();
     }
 
+    RefCounted() = default;
+
+    // A copy is a new object without owners
+    RefCounted(const RefCounted&) : counter_() {
+    }
+
     RefCounted& operator=(const RefCounted&) {
         return *this;
     }
@@ -62,6 +255,17 @@ private:
 template <typename Derived, typename D = DefaultDelete>
 using SimpleRefCounted = RefCounted<Derived, SimpleCounter, D>;
 
+// RefCounted is exactly as large as its counter, so the fields of Derived start right after it
+// (a 32-bit counter followed by a 32-bit field takes 8 bytes).
+template <typename Derived, typename D = DefaultDelete>
+using SmallRefCounted = RefCounted<Derived, NarrowCounter<uint32_t>, D>;
+
+template <typename Derived, typename D = DefaultDelete>
+using TinyRefCounted = RefCounted<Derived, NarrowCounter<uint16_t>, D>;
+
+template <typename Derived, typename D = DefaultDelete>
+using AtomicRefCounted = RefCounted<Derived, AtomicCounter, D>;
+
 template <typename T>
 class IntrusivePtr {
     template <typename Y>
@@ -158,24 +362,25 @@ public:
 
     // Destructor
     ~IntrusivePtr() {
-        Reset();
+        if (ptr_) {
+            ptr_->DecRef();
+        }
     }
 
     // Modifiers
+    // The pointer is cleared before the release, so a destructor reaching back here sees nullptr
     void Reset() {
-        if (ptr_) {
-            ptr_->DecRef();
-            ptr_ = nullptr;
+        if (T* old = std::exchange(ptr_, nullptr)) {
+            old->DecRef();
         }
     }
 
     void Reset(T* ptr) {
-        if (ptr_) {
-            ptr_->DecRef();
-        }
-        ptr_ = ptr;
         if (ptr) {
-            ptr_->IncRef();
+            ptr->IncRef();
+        }
+        if (T* old = std::exchange(ptr_, ptr)) {
+            old->DecRef();
         }
     }
 
@@ -183,6 +388,18 @@ public:
         std::swap(ptr_, other.ptr_);
     }
 
+    // Gives up the reference without decrementing the counter
+    T* Detach() {
+        return std::exchange(ptr_, nullptr);
+    }
+
+    // Takes over a reference that has already been counted (e.g. one from `Detach()`)
+    static IntrusivePtr Adopt(T* ptr) {
+        IntrusivePtr result;
+        result.ptr_ = ptr;
+        return result;
+    }
+
     // Observers
     T* Get() const {
         if (ptr_) {
@@ -212,13 +429,93 @@ public:
         return false;
     }
 
+    void PrefetchTarget() const {
+        PrefetchRead(ptr_);
+    }
+
+    // The counter is inside the object
+    void PrefetchCounts() const {
+        PrefetchWrite(ptr_);
+    }
+
 private:
     T* ptr_;
 };
 
+template <typename T>
+struct IsTriviallyRelocatable<IntrusivePtr<T>> : std::true_type {};
+
+// The bulk operations merge count updates only for objects counted with AtomicCounter
+template <typename T, typename = void>
+struct HasAtomicCounter : std::false_type {};
+
+template <typename T>
+struct HasAtomicCounter<T, std::void_t<typename T::CounterType>>
+    : std::is_same<typename T::CounterType, AtomicCounter> {};
+
+template <typename T>
+struct BulkCounts<IntrusivePtr<T>> {
+    static constexpr bool kCoalesce = HasAtomicCounter<T>::value;
+
+    using Key = T;
+
+    static T* KeyOf(const IntrusivePtr<T>& ptr) {
+        return ptr.Get();
+    }
+
+    static IntrusivePtr<T> CopyUncounted(const IntrusivePtr<T>& ptr) {
+        return IntrusivePtr<T>::Adopt(ptr.Get());
+    }
+
+    static void Forget(IntrusivePtr<T>& ptr) {
+        ptr.Detach();
+    }
+
+    static void Add(T* object, size_t n) {
+        object->IncRef(n);
+    }
+
+    static void Sub(T* object, size_t n) {
+        object->DecRef(n);
+    }
+};
+
+// Number of cached slots if T is destroyed with RecycleDelete, 0 otherwise
+template <typename T, typename = void>
+struct RecycleSlots : std::integral_constant<size_t, 0> {};
+
+template <typename T>
+struct RecycleSlots<T, std::void_t<typename T::DeleterType>>
+    : RecycleSlots<typename T::DeleterType> {};
+
+template <size_t N>
+struct RecycleSlots<RecycleDelete<N>> : std::integral_constant<size_t, N> {};
+
 template <typename T, typename... Args>
 IntrusivePtr<T> MakeIntrusive(Args&&... args) {
-    T* a = new T(std::forward<Args>(args)...);
-    IntrusivePtr<T> t(a);
-    return t;
+    if constexpr (RecycleSlots<T>::value > 0) {
+        using Cache = RecycleCache<T, RecycleSlots<T>::value>;
+        void* storage = Cache::Take();
+        if (!storage) {
+            storage = Allocate(sizeof(T), alignof(T));
+        }
+#ifdef SMART_PTR_NO_EXCEPTIONS
+        T* a = new (storage) T(std::forward<Args>(args)...);
+#else
+        T* a;
+        try {
+            a = new (storage) T(std::forward<Args>(args)...);
+        } catch (...) {
+            if (!Cache::Put(storage)) {
+                Deallocate(storage, sizeof(T), alignof(T));
+            }
+            throw;
+        }
+#endif
+        return IntrusivePtr<T>(a);
+    } else {
+        T* a = new T(std::forward<Args>(args)...);
+        IntrusivePtr<T> t(a);
+        return t;
+    }
 }
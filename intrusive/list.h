@@ -0,0 +1,258 @@
+#pragma once
+
+#include "hooks.h"
+#include "intrusive.h"
+
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// Doubly-linked list whose links live in the elements (`Hook` is the ListHook member used by
+// this list). Insert, erase and splice allocate nothing; the list keeps one reference to
+// every element, taken over from the IntrusivePtr passed in and handed back on removal.
+template <typename T, ListHook T::*Hook>
+class IntrusiveList {
+    template <bool kConst>
+    class Iterator {
+        friend class IntrusiveList;
+
+        template <bool>
+        friend class Iterator;
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<kConst, const T*, T*>;
+        using reference = std::conditional_t<kConst, const T&, T&>;
+
+        Iterator() = default;
+
+        // iterator -> const_iterator
+        template <bool kOther, typename = std::enable_if_t<kConst && !kOther>>
+        Iterator(const Iterator<kOther>& other) : hook_(other.hook_) {
+        }
+
+        reference operator*() const {
+            return *Owner(hook_);
+        }
+
+        pointer operator->() const {
+            return Owner(hook_);
+        }
+
+        Iterator& operator++() {
+            hook_ = hook_->next_;
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        Iterator& operator--() {
+            hook_ = hook_->prev_;
+            return *this;
+        }
+
+        Iterator operator--(int) {
+            Iterator old = *this;
+            --*this;
+            return old;
+        }
+
+        friend bool operator==(const Iterator& left, const Iterator& right) {
+            return left.hook_ == right.hook_;
+        }
+
+    private:
+        explicit Iterator(ListHook* hook) : hook_(hook) {
+        }
+
+        ListHook* hook_ = nullptr;
+    };
+
+public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    IntrusiveList() {
+        head_.prev_ = head_.next_ = &head_;
+    }
+
+    IntrusiveList(const IntrusiveList&) = delete;
+    IntrusiveList& operator=(const IntrusiveList&) = delete;
+
+    IntrusiveList(IntrusiveList&& other) : IntrusiveList() {
+        Splice(end(), other);
+    }
+
+    IntrusiveList& operator=(IntrusiveList&& other) {
+        if (this != &other) {
+            Clear();
+            Splice(end(), other);
+        }
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    ~IntrusiveList() {
+        Clear();
+        head_.prev_ = head_.next_ = nullptr;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    // `element` must not be null; throws std::logic_error if it is already in a list on `Hook`
+    iterator Insert(const_iterator position, IntrusivePtr<T> element) {
+        ListHook* hook = &(element.Get()->*Hook);
+        if (hook->IsLinked()) {
+            throw std::logic_error("the element is already in a list");
+        }
+        Link(hook, position.hook_);
+        element.Detach();
+        ++size_;
+        return iterator(hook);
+    }
+
+    void PushBack(IntrusivePtr<T> element) {
+        Insert(end(), std::move(element));
+    }
+
+    void PushFront(IntrusivePtr<T> element) {
+        Insert(begin(), std::move(element));
+    }
+
+    // Unlinks `element`, which must be in this list, and returns the reference the list held
+    IntrusivePtr<T> Erase(T& element) {
+        ListHook* hook = &(element.*Hook);
+        Unlink(hook);
+        --size_;
+        return IntrusivePtr<T>::Adopt(&element);
+    }
+
+    iterator Erase(const_iterator position) {
+        iterator next(position.hook_->next_);
+        Erase(*Owner(position.hook_));
+        return next;
+    }
+
+    IntrusivePtr<T> PopFront() {
+        return Erase(Front());
+    }
+
+    IntrusivePtr<T> PopBack() {
+        return Erase(Back());
+    }
+
+    // Moves `element` from `other` (which may be this list) to just before `position`
+    void Splice(const_iterator position, IntrusiveList& other, T& element) {
+        ListHook* hook = &(element.*Hook);
+        if (hook == position.hook_) {
+            return;
+        }
+        Unlink(hook);
+        Link(hook, position.hook_);
+        --other.size_;
+        ++size_;
+    }
+
+    // Moves all elements of `other` to just before `position`
+    void Splice(const_iterator position, IntrusiveList& other) {
+        if (&other == this || other.Empty()) {
+            return;
+        }
+        ListHook* first = other.head_.next_;
+        ListHook* last = other.head_.prev_;
+        other.head_.prev_ = other.head_.next_ = &other.head_;
+
+        ListHook* next = position.hook_;
+        first->prev_ = next->prev_;
+        next->prev_->next_ = first;
+        last->next_ = next;
+        next->prev_ = last;
+
+        size_ += std::exchange(other.size_, 0);
+    }
+
+    // Releases every element; an element destroyed on the way may still use the list
+    void Clear() {
+        while (!Empty()) {
+            PopFront();
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    size_t Size() const {
+        return size_;
+    }
+
+    bool Empty() const {
+        return size_ == 0;
+    }
+
+    T& Front() {
+        return *Owner(head_.next_);
+    }
+
+    const T& Front() const {
+        return *Owner(head_.next_);
+    }
+
+    T& Back() {
+        return *Owner(head_.prev_);
+    }
+
+    const T& Back() const {
+        return *Owner(head_.prev_);
+    }
+
+    iterator begin() {
+        return iterator(head_.next_);
+    }
+
+    iterator end() {
+        return iterator(&head_);
+    }
+
+    const_iterator begin() const {
+        return const_iterator(head_.next_);
+    }
+
+    const_iterator end() const {
+        return const_iterator(const_cast<ListHook*>(&head_));
+    }
+
+private:
+    static T* Owner(const ListHook* hook) {
+        return hook_detail::OwnerOf<T, ListHook, Hook>(hook);
+    }
+
+    static void Link(ListHook* hook, ListHook* next) {
+        hook->prev_ = next->prev_;
+        hook->next_ = next;
+        next->prev_->next_ = hook;
+        next->prev_ = hook;
+    }
+
+    static void Unlink(ListHook* hook) {
+        hook->prev_->next_ = hook->next_;
+        hook->next_->prev_ = hook->prev_;
+        hook->prev_ = hook->next_ = nullptr;
+    }
+
+    ListHook head_;
+    size_t size_ = 0;
+};
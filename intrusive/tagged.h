@@ -0,0 +1,128 @@
+#pragma once
+
+#include "intrusive.h"
+
+#include <cassert>
+#include <cstddef>  // for std::nullptr_t
+#include <cstdint>
+#include <utility>  // for std::exchange / std::swap
+
+// IntrusivePtr that keeps a `Bits`-bit tag in the alignment bits of the pointer.
+// Copies and moves carry the tag along with the reference.
+template <typename T, size_t Bits>
+class TaggedIntrusivePtr {
+    static_assert(Bits > 0);
+    static_assert(alignof(T) >= (size_t{1} << Bits), "alignof(T) leaves too few free bits");
+
+    static constexpr uintptr_t kTagMask = (uintptr_t{1} << Bits) - 1;
+
+public:
+    // Constructors
+    TaggedIntrusivePtr() : bits_(0) {
+    }
+
+    TaggedIntrusivePtr(std::nullptr_t) : bits_(0) {
+    }
+
+    TaggedIntrusivePtr(T* ptr, uintptr_t tag = 0) : bits_(Pack(ptr, tag)) {
+        if (ptr) {
+            ptr->IncRef();
+        }
+    }
+
+    TaggedIntrusivePtr(const TaggedIntrusivePtr& other) : bits_(other.bits_) {
+        if (T* ptr = Get()) {
+            ptr->IncRef();
+        }
+    }
+
+    TaggedIntrusivePtr(TaggedIntrusivePtr&& other) : bits_(other.bits_) {
+        other.bits_ &= kTagMask;
+    }
+
+    // `operator=`-s
+    TaggedIntrusivePtr& operator=(const TaggedIntrusivePtr& other) {
+        TaggedIntrusivePtr(other).Swap(*this);
+        return *this;
+    }
+
+    TaggedIntrusivePtr& operator=(TaggedIntrusivePtr&& other) {
+        TaggedIntrusivePtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    // Destructor
+    ~TaggedIntrusivePtr() {
+        if (T* ptr = Get()) {
+            ptr->DecRef();
+        }
+    }
+
+    // Modifiers
+    void Reset() {
+        if (T* ptr = Get()) {
+            bits_ &= kTagMask;
+            ptr->DecRef();
+        }
+    }
+
+    void Reset(T* ptr) {
+        TaggedIntrusivePtr(ptr, GetTag()).Swap(*this);
+    }
+
+    void Swap(TaggedIntrusivePtr& other) {
+        std::swap(bits_, other.bits_);
+    }
+
+    void SetTag(uintptr_t tag) {
+        bits_ = Pack(Get(), tag);
+    }
+
+    // Observers
+    T* Get() const {
+        return reinterpret_cast<T*>(bits_ & ~kTagMask);
+    }
+
+    uintptr_t GetTag() const {
+        return bits_ & kTagMask;
+    }
+
+    T& operator*() const {
+        return *Get();
+    }
+
+    T* operator->() const {
+        return Get();
+    }
+
+    size_t UseCount() const {
+        if (T* ptr = Get()) {
+            return ptr->RefCount();
+        }
+        return 0;
+    }
+
+    explicit operator bool() const {
+        return Get() != nullptr;
+    }
+
+    void PrefetchTarget() const {
+        PrefetchRead(Get());
+    }
+
+    void PrefetchCounts() const {
+        PrefetchWrite(Get());
+    }
+
+private:
+    // A tag wider than the free bits would lose data, so it is a bug rather than truncated
+    static uintptr_t Pack(T* ptr, uintptr_t tag) {
+        assert(tag <= kTagMask);
+        return reinterpret_cast<uintptr_t>(ptr) | (tag & kTagMask);
+    }
+
+    uintptr_t bits_;
+};
+
+template <typename T, size_t Bits>
+struct IsTriviallyRelocatable<TaggedIntrusivePtr<T, Bits>> : std::true_type {};
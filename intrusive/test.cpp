@@ -1,10 +1,25 @@
 #include "intrusive.h"
+#include "compressed.h"
+#include "hash_set.h"
+#include "list.h"
+#include "tagged.h"
+
+#include <common/bulk.h>
+#include <common/parallel_release.h>
+#include <common/prefetch.h>
 
 #include <catch.hpp>
 
 #include "allocations_checker.h"
 
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -173,6 +188,16 @@ TEST_CASE("Modifiers") {
 
     CountedString::ResetCounters();
 
+    SECTION("Reset(T*) with the held pointer") {
+        IntrusivePtr<CountedString> p{new CountedString{"same"}};
+        p.Reset(p.Get());
+        REQUIRE(CountedString::NumAlive() == 1);
+        REQUIRE(p.UseCount() == 1);
+        REQUIRE(*p == "same");
+    }
+
+    CountedString::ResetCounters();
+
     SECTION("Swap") {
         IntrusivePtr<CountedString> p{new CountedString{"first"}};
         IntrusivePtr<CountedString> q{new CountedString{"second"}};
@@ -397,3 +422,647 @@ TEST_CASE("Object pool") {
         REQUIRE(strs.NumInUse() == 1);
     }
 }
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct Message : public RefCounted<Message, SimpleCounter, RecycleDelete<2>> {
+    Message(int id) : id{id} {
+        ++alive;
+    }
+
+    ~Message() {
+        --alive;
+    }
+
+    int id;
+
+    inline static int alive = 0;
+};
+
+TEST_CASE("RecycleDelete") {
+    // Takes every cached slot, so that the next release goes to the front of the cache
+    auto drain = [] {
+        return std::make_pair(MakeIntrusive<Message>(-1), MakeIntrusive<Message>(-2));
+    };
+
+    SECTION("Storage is reused") {
+        auto cached = drain();
+        Message* first = MakeIntrusive<Message>(1).Get();
+        REQUIRE(Message::alive == 2);
+
+        auto a = MakeIntrusive<Message>(2);
+        REQUIRE(a.Get() == first);
+        REQUIRE(a->id == 2);
+        REQUIRE(Message::alive == 3);
+    }
+
+    SECTION("Steady state does not allocate") {
+        { auto warm_up = MakeIntrusive<Message>(0); }
+        EXPECT_ZERO_ALLOCATIONS(auto a = MakeIntrusive<Message>(1); a.Reset();
+                                auto b = MakeIntrusive<Message>(2););
+    }
+
+    SECTION("Cache is bounded") {
+        {
+            auto a = MakeIntrusive<Message>(1);
+            auto b = MakeIntrusive<Message>(2);
+            auto c = MakeIntrusive<Message>(3);
+        }
+        REQUIRE(Message::alive == 0);
+        EXPECT_ZERO_ALLOCATIONS(auto a = MakeIntrusive<Message>(1);
+                                auto b = MakeIntrusive<Message>(2););
+        EXPECT_ONE_ALLOCATION(auto a = MakeIntrusive<Message>(1);
+                              auto b = MakeIntrusive<Message>(2);
+                              auto c = MakeIntrusive<Message>(3););
+    }
+
+    SECTION("Objects created with new") {
+        auto cached = drain();
+        IntrusivePtr<Message> a(new Message(1));
+        Message* p = a.Get();
+        a.Reset();
+        REQUIRE(MakeIntrusive<Message>(2).Get() == p);
+    }
+
+    SECTION("Released after the cache of the thread") {
+        std::thread([] {
+            // Constructed before the cache, so destroyed after it
+            thread_local IntrusivePtr<Message> late;
+            late = MakeIntrusive<Message>(1);
+            auto cached = MakeIntrusive<Message>(2);
+        }).join();
+        REQUIRE(Message::alive == 0);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct NodeArena;
+using TestArena = VirtualArena<NodeArena>;
+
+struct ArenaNode : public SimpleRefCounted<ArenaNode, ArenaDelete<TestArena>> {
+    ArenaNode(int value) : value{value} {
+    }
+
+    int value;
+    CompressedIntrusivePtr<ArenaNode, TestArena> next;
+};
+
+struct ArenaLeaf : ArenaNode {
+    using ArenaNode::ArenaNode;
+};
+
+TEST_CASE("CompressedIntrusivePtr") {
+    using Ptr = CompressedIntrusivePtr<ArenaNode, TestArena>;
+
+    SECTION("Sizeof") {
+        REQUIRE(sizeof(Ptr) == sizeof(uint32_t));
+    }
+
+    SECTION("Empty state") {
+        Ptr a, b;
+        b = a;
+        Ptr c(a);
+        b = std::move(c);
+
+        REQUIRE(a.Get() == nullptr);
+        REQUIRE(!b);
+        REQUIRE(c.UseCount() == 0);
+    }
+
+    SECTION("Reference counting") {
+        auto a = MakeCompressedIntrusive<ArenaNode, TestArena>(1);
+        REQUIRE(a->value == 1);
+        REQUIRE(a.UseCount() == 1);
+
+        Ptr b = a;
+        Ptr c = std::move(b);
+        REQUIRE(!b);
+        REQUIRE(a.UseCount() == 2);
+        REQUIRE(c.Get() == a.Get());
+
+        IntrusivePtr<ArenaNode> full = a.ToIntrusive();
+        REQUIRE(a.UseCount() == 3);
+        REQUIRE(full.Get() == a.Get());
+
+        Ptr d(full.Get());
+        REQUIRE(d.Get() == a.Get());
+        REQUIRE(d.UseCount() == 4);
+    }
+
+    SECTION("Storage is reused") {
+        ArenaNode* p = MakeCompressedIntrusive<ArenaNode, TestArena>(1).Get();
+        size_t used = TestArena::Used();
+        auto a = MakeCompressedIntrusive<ArenaNode, TestArena>(2);
+        REQUIRE(a.Get() == p);
+        REQUIRE(TestArena::Used() == used);
+    }
+
+    SECTION("Chains") {
+        auto head = MakeCompressedIntrusive<ArenaNode, TestArena>(0);
+        ArenaNode* tail = head.Get();
+        for (int i = 1; i < 100; ++i) {
+            tail->next = MakeCompressedIntrusive<ArenaNode, TestArena>(i);
+            tail = tail->next.Get();
+        }
+
+        int sum = 0;
+        for (auto* node = head.Get(); node; node = node->next.Get()) {
+            sum += node->value;
+        }
+        REQUIRE(sum == 4950);
+    }
+
+    SECTION("Conversions") {
+        using LeafPtr = CompressedIntrusivePtr<ArenaLeaf, TestArena>;
+        static_assert(std::is_convertible_v<const LeafPtr&, Ptr>);
+        static_assert(!std::is_constructible_v<LeafPtr, const Ptr&>);
+    }
+
+    SECTION("Oversized allocation") {
+        REQUIRE_THROWS_AS(TestArena::Allocate(TestArena::kMaxObjectSize + 1), std::bad_alloc);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("TaggedIntrusivePtr") {
+    using Ptr = TaggedIntrusivePtr<MyString, 3>;
+
+    SECTION("Sizeof") {
+        REQUIRE(sizeof(Ptr) == sizeof(void*));
+    }
+
+    SECTION("Tag and reference") {
+        Ptr a(new MyString("tagged"), 5);
+        REQUIRE(a.GetTag() == 5);
+        REQUIRE(*a == "tagged");
+        REQUIRE(a->size() == 6);
+        REQUIRE(a.UseCount() == 1);
+
+        Ptr b = a;
+        REQUIRE(b.GetTag() == 5);
+        REQUIRE(a.UseCount() == 2);
+
+        b.SetTag(2);
+        REQUIRE(a.GetTag() == 5);
+        REQUIRE(b.Get() == a.Get());
+
+        Ptr c = std::move(b);
+        REQUIRE(!b);
+        REQUIRE(c.GetTag() == 2);
+        REQUIRE(c.UseCount() == 2);
+    }
+
+    SECTION("Reset keeps the tag") {
+        Ptr a(new MyString("first"), 7);
+        a.Reset(new MyString("second"));
+        REQUIRE(*a == "second");
+        REQUIRE(a.GetTag() == 7);
+
+        a.Reset();
+        REQUIRE(!a);
+        REQUIRE(a.GetTag() == 7);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct SmallFoo : public SmallRefCounted<SmallFoo> {
+    uint32_t value = 0;
+};
+
+struct TinyFoo : public TinyRefCounted<TinyFoo> {
+    uint16_t kind = 0;
+    uint32_t value = 0;
+};
+
+struct TinyChar : public TinyRefCounted<TinyChar> {
+    char c = 0;
+};
+
+TEST_CASE("Narrow counters") {
+    SECTION("Layout") {
+        static_assert(sizeof(SmallRefCounted<SmallFoo>) == sizeof(uint32_t));
+        static_assert(sizeof(SmallFoo) == 8);
+        static_assert(sizeof(TinyFoo) == 8);
+        static_assert(sizeof(TinyChar) == 4);
+    }
+
+    SECTION("Counting") {
+        IntrusivePtr<SmallFoo> a(new SmallFoo);
+        auto b = a;
+        REQUIRE(a.UseCount() == 2);
+        b.Reset();
+        REQUIRE(a.UseCount() == 1);
+    }
+
+    SECTION("Saturation makes the object immortal") {
+        NarrowCounter<uint16_t> counter;
+        for (size_t i = 0; i < 70000; ++i) {
+            counter.IncRef();
+        }
+        REQUIRE(counter.RefCount() == 65535);
+        REQUIRE(counter.DecRef() == 65535);
+        REQUIRE(counter.RefCount() == 65535);
+    }
+
+    SECTION("Abort policy counts up to the maximum") {
+        NarrowCounter<uint16_t, AbortOnOverflow> counter;
+        for (size_t i = 0; i < 65535; ++i) {
+            counter.IncRef();
+        }
+        REQUIRE(counter.RefCount() == 65535);
+        REQUIRE(counter.DecRef() == 65534);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Trivial relocation") {
+    static_assert(kIsTriviallyRelocatable<IntrusivePtr<MyString>>);
+    static_assert(kIsTriviallyRelocatable<TaggedIntrusivePtr<MyString, 3>>);
+    static_assert(kIsTriviallyRelocatable<CompressedIntrusivePtr<ArenaNode, TestArena>>);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct ChainLink : SimpleRefCounted<ChainLink, IterativeDelete<>> {
+    IntrusivePtr<ChainLink> next;
+};
+
+TEST_CASE("IterativeDelete") {
+    constexpr size_t kLength = 1'000'000;
+    IntrusivePtr<ChainLink> head;
+    for (size_t i = 0; i < kLength; ++i) {
+        auto link = MakeIntrusive<ChainLink>();
+        link->next = std::move(head);
+        head = std::move(link);
+    }
+
+    ChainLink* second = head->next.Get();
+    IntrusivePtr<ChainLink> keep(second);
+    head.Reset();
+    REQUIRE(keep.UseCount() == 1);
+
+    keep.Reset();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct SharedNode : AtomicRefCounted<SharedNode, ParallelDelete<>> {
+    std::vector<IntrusivePtr<SharedNode>> children;
+
+    ~SharedNode() {
+        destroyed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline static std::atomic<size_t> destroyed = 0;
+};
+
+TEST_CASE("ParallelDelete") {
+    // Every node of a level points to all nodes of the next one
+    constexpr size_t kLevels = 64;
+    constexpr size_t kWidth = 64;
+    std::vector<IntrusivePtr<SharedNode>> level;
+    for (size_t i = 0; i < kLevels; ++i) {
+        std::vector<IntrusivePtr<SharedNode>> next;
+        for (size_t j = 0; j < kWidth; ++j) {
+            auto node = MakeIntrusive<SharedNode>();
+            node->children = level;
+            next.push_back(std::move(node));
+        }
+        level = std::move(next);
+    }
+    auto root = MakeIntrusive<SharedNode>();
+    root->children = std::move(level);
+    SharedNode::destroyed = 0;
+
+    ParallelReleasePool pool(4);
+    pool.Release(std::move(root)).wait();
+    REQUIRE(SharedNode::destroyed == kLevels * kWidth + 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("ForEachDeref") {
+    std::vector<IntrusivePtr<MyInt>> values;
+    for (int i = 0; i < 20; ++i) {
+        values.push_back(MakeIntrusive<MyInt>(i));
+    }
+    values.emplace_back();
+
+    int sum = 0;
+    ForEachDeref(values, [&](MyInt& value) { sum += value.value; }, 4);
+    REQUIRE(sum == 190);
+
+    std::vector<IntrusivePtr<MyInt>> copies;
+    ForEachPtr(values, [&](const IntrusivePtr<MyInt>& ptr) { copies.push_back(ptr); });
+    REQUIRE(values[0].UseCount() == 2);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct AtomicInt : AtomicRefCounted<AtomicInt> {
+    explicit AtomicInt(int value) : value(value) {
+    }
+
+    int value;
+};
+
+// Appends to `out` and throws std::bad_alloc once it holds `limit` elements
+template <typename T>
+class LimitedInserter {
+public:
+    using iterator_category = std::output_iterator_tag;
+    using value_type = void;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = void;
+
+    LimitedInserter(std::vector<T>& out, size_t limit) : out_(&out), limit_(limit) {
+    }
+
+    LimitedInserter& operator=(T value) {
+        if (out_->size() == limit_) {
+            throw std::bad_alloc();
+        }
+        out_->push_back(std::move(value));
+        return *this;
+    }
+
+    LimitedInserter& operator*() {
+        return *this;
+    }
+
+    LimitedInserter& operator++() {
+        return *this;
+    }
+
+private:
+    std::vector<T>* out_;
+    size_t limit_;
+};
+
+template <typename T>
+void CheckBulkCounts() {
+    auto hot = MakeIntrusive<T>(1);
+    auto cold = MakeIntrusive<T>(2);
+    std::vector<IntrusivePtr<T>> values(1000, hot);
+    values[10] = cold;
+    values[20] = nullptr;
+
+    std::vector<IntrusivePtr<T>> copies;
+    CopyAll(values, std::back_inserter(copies));
+    REQUIRE(hot.UseCount() == 2 * 998 + 1);
+    REQUIRE(cold.UseCount() == 3);
+    REQUIRE(copies[10].Get() == cold.Get());
+    REQUIRE(!copies[20]);
+
+    // An output that throws drops only references that were counted
+    std::vector<IntrusivePtr<T>> partial;
+    REQUIRE_THROWS_AS(CopyAll(values, LimitedInserter<IntrusivePtr<T>>(partial, 15)),
+                      std::bad_alloc);
+    partial.clear();
+    REQUIRE(hot.UseCount() == 2 * 998 + 1);
+    REQUIRE(cold.UseCount() == 3);
+    std::vector<IntrusivePtr<T>> lone{MakeIntrusive<T>(3)};
+    REQUIRE_THROWS_AS(CopyAll(lone, LimitedInserter<IntrusivePtr<T>>(partial, 0)),
+                      std::bad_alloc);
+    REQUIRE(lone[0].UseCount() == 1);
+
+    // Copying a range onto itself
+    REQUIRE(CopyAll(values, values.begin()) == values.end());
+    REQUIRE(hot.UseCount() == 2 * 998 + 1);
+    REQUIRE(cold.UseCount() == 3);
+
+    ReleaseAll(values);
+    REQUIRE(!values[0]);
+    REQUIRE(hot.UseCount() == 998 + 1);
+
+    // The last owner of `hot` is in `copies`
+    hot.Reset();
+    ReleaseAll(copies);
+    REQUIRE(cold.UseCount() == 1);
+}
+
+TEST_CASE("Bulk reference counts") {
+    static_assert(BulkCounts<IntrusivePtr<AtomicInt>>::kCoalesce);
+    static_assert(!BulkCounts<IntrusivePtr<MyInt>>::kCoalesce);
+
+    SECTION("Atomic counters") {
+        CheckBulkCounts<AtomicInt>();
+    }
+
+    SECTION("Plain counters") {
+        CheckBulkCounts<MyInt>();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct Connection : public SimpleRefCounted<Connection> {
+    explicit Connection(int id) : id(id) {
+    }
+
+    ~Connection() {
+        ++destroyed;
+    }
+
+    int id;
+    ListHook lru;
+    ListHook queue;
+    SetHook by_id;
+
+    inline static int destroyed = 0;
+};
+
+struct ConnectionHash {
+    size_t operator()(int id) const {
+        return std::hash<int>()(id);
+    }
+
+    size_t operator()(const Connection& connection) const {
+        return (*this)(connection.id);
+    }
+};
+
+struct ConnectionEqual {
+    bool operator()(const Connection& left, int id) const {
+        return left.id == id;
+    }
+
+    bool operator()(const Connection& left, const Connection& right) const {
+        return left.id == right.id;
+    }
+};
+
+using LruList = IntrusiveList<Connection, &Connection::lru>;
+using QueueList = IntrusiveList<Connection, &Connection::queue>;
+using ConnectionSet =
+    IntrusiveHashSet<Connection, &Connection::by_id, ConnectionHash, ConnectionEqual>;
+
+// The hook sits after a virtual base and a vtable pointer
+struct Labeled {
+    virtual ~Labeled() = default;
+
+    std::string label = "session";
+};
+
+struct Session : public SimpleRefCounted<Session>, public virtual Labeled {
+    explicit Session(int id) : id(id) {
+    }
+
+    int id;
+    ListHook lru;
+};
+
+template <typename List>
+std::vector<int> Ids(const List& list) {
+    std::vector<int> ids;
+    for (const Connection& connection : list) {
+        ids.push_back(connection.id);
+    }
+    return ids;
+}
+
+TEST_CASE("IntrusiveList") {
+    Connection::destroyed = 0;
+
+    SECTION("Membership holds a reference") {
+        LruList lru;
+        auto first = MakeIntrusive<Connection>(1);
+        lru.PushBack(first);
+        lru.PushBack(MakeIntrusive<Connection>(2));
+        lru.PushFront(MakeIntrusive<Connection>(0));
+        REQUIRE(lru.Size() == 3);
+        REQUIRE(Ids(lru) == std::vector<int>{0, 1, 2});
+        REQUIRE(first.UseCount() == 2);
+        REQUIRE(first->lru.IsLinked());
+
+        IntrusivePtr<Connection> removed = lru.Erase(*first);
+        REQUIRE(!first->lru.IsLinked());
+        REQUIRE(removed.UseCount() == 2);
+        REQUIRE(Ids(lru) == std::vector<int>{0, 2});
+
+        lru.PopFront();
+        REQUIRE(Connection::destroyed == 1);
+        REQUIRE(lru.Back().id == 2);
+        lru.Clear();
+        REQUIRE(Connection::destroyed == 2);
+        REQUIRE(lru.Empty());
+    }
+
+    SECTION("One element in two lists") {
+        LruList lru;
+        QueueList queue;
+        auto connection = MakeIntrusive<Connection>(7);
+        lru.PushBack(connection);
+        queue.PushBack(connection);
+        REQUIRE(connection.UseCount() == 3);
+        REQUIRE_THROWS_AS(lru.PushBack(connection), std::logic_error);
+        REQUIRE(connection.UseCount() == 3);
+
+        connection.Reset();
+        lru.Clear();
+        REQUIRE(Connection::destroyed == 0);
+        queue.Clear();
+        REQUIRE(Connection::destroyed == 1);
+    }
+
+    SECTION("Splice") {
+        LruList lru;
+        for (int i = 0; i < 4; ++i) {
+            lru.PushBack(MakeIntrusive<Connection>(i));
+        }
+        // Touching an element moves it to the back
+        Connection& touched = *std::next(lru.begin());
+        lru.Splice(lru.end(), lru, touched);
+        REQUIRE(Ids(lru) == std::vector<int>{0, 2, 3, 1});
+        lru.Splice(lru.begin(), lru, lru.Front());
+        REQUIRE(Ids(lru) == std::vector<int>{0, 2, 3, 1});
+
+        LruList other;
+        other.PushBack(MakeIntrusive<Connection>(10));
+        other.Splice(other.begin(), lru, lru.Back());
+        REQUIRE(Ids(other) == std::vector<int>{1, 10});
+        REQUIRE(lru.Size() == 3);
+
+        lru.Splice(std::next(lru.begin()), other);
+        REQUIRE(Ids(lru) == std::vector<int>{0, 1, 10, 2, 3});
+        REQUIRE(other.Empty());
+        REQUIRE(lru.Size() == 5);
+
+        LruList moved(std::move(lru));
+        REQUIRE(lru.Empty());
+        REQUIRE(moved.Size() == 5);
+        REQUIRE(Connection::destroyed == 0);
+    }
+
+    SECTION("Iterators") {
+        LruList lru;
+        for (int i = 0; i < 5; ++i) {
+            lru.PushBack(MakeIntrusive<Connection>(i));
+        }
+        for (auto it = lru.begin(); it != lru.end();) {
+            it = it->id % 2 == 0 ? lru.Erase(it) : std::next(it);
+        }
+        REQUIRE(Ids(lru) == std::vector<int>{1, 3});
+        REQUIRE(Connection::destroyed == 3);
+        REQUIRE(std::prev(lru.end())->id == 3);
+
+        auto position = lru.Insert(lru.begin(), MakeIntrusive<Connection>(9));
+        REQUIRE(position->id == 9);
+        REQUIRE(lru.Front().id == 9);
+    }
+
+    SECTION("Element with a virtual base") {
+        IntrusiveList<Session, &Session::lru> lru;
+        for (int i = 0; i < 3; ++i) {
+            lru.PushBack(MakeIntrusive<Session>(i));
+        }
+        REQUIRE(lru.Front().id == 0);
+        REQUIRE(lru.Back().id == 2);
+        REQUIRE(lru.Back().label == "session");
+        lru.Clear();
+    }
+}
+
+TEST_CASE("IntrusiveHashSet") {
+    Connection::destroyed = 0;
+    ConnectionSet set(4);
+    LruList lru;
+    for (int i = 0; i < 100; ++i) {
+        auto connection = MakeIntrusive<Connection>(i);
+        lru.PushBack(connection);
+        REQUIRE(set.Insert(std::move(connection)));
+    }
+    REQUIRE(set.Size() == 100);
+    REQUIRE(set.Find(42)->id == 42);
+    REQUIRE(set.Find(100) == nullptr);
+    REQUIRE(!set.Insert(MakeIntrusive<Connection>(42)));
+    REQUIRE(Connection::destroyed == 1);
+
+    set.Rehash(128);
+    REQUIRE(set.BucketCount() == 128);
+    int sum = 0;
+    for (const Connection& connection : set) {
+        sum += connection.id;
+    }
+    REQUIRE(sum == 4950);
+
+    Connection& evicted = lru.Front();
+    auto reference = set.Erase(evicted);
+    REQUIRE(!set.Contains(0));
+    REQUIRE(reference.UseCount() == 2);
+    IntrusivePtr<Connection> one(set.Find(1));
+    REQUIRE_THROWS_AS(set.Insert(one), std::logic_error);
+    one.Reset();
+
+    set.Clear();
+    REQUIRE(set.Empty());
+    REQUIRE(Connection::destroyed == 1);
+    lru.Clear();
+    reference.Reset();
+    REQUIRE(Connection::destroyed == 101);
+}
@@ -1,12 +1,12 @@
 #pragma once
 
-#include <exception>
+#include <common/shared_fwd.h>
 
-// Instead of std::bad_weak_ptr
-class BadWeakPtr : public std::exception {};
+// Strong and weak references with SharedFromThis, not thread-safe
+using SharedConfig = SharedPolicy<PlainCount, WithWeak, WithSharedFromThis, DefaultAllocation>;
 
 template <typename T>
-class SharedPtr;
+using SharedPtr = BasicSharedPtr<T, SharedConfig>;
 
 template <typename T>
-class WeakPtr;
+using WeakPtr = BasicWeakPtr<T, SharedConfig>;
@@ -71,6 +71,78 @@ TEST_CASE("SharedFromThis") {
     }
 }
 
+TEST_CASE("SharedFromThis with a custom deleter") {
+    T t;
+    {
+        SharedPtr<T> s(&t, NullDeleter);
+        REQUIRE(t.SharedFromThis() == s);
+        REQUIRE(s.UseCount() == 1);
+    }
+    REQUIRE(t.WeakFromThis().Expired());
+}
+
+TEST_CASE("TrySharedFromThis") {
+    T* ptr = new T;
+    const T* cptr = ptr;
+
+    static_assert(noexcept(ptr->TrySharedFromThis()), "Operation must be noexcept");
+    static_assert(noexcept(cptr->TrySharedFromThis()), "Operation must be noexcept");
+
+    REQUIRE(!ptr->TrySharedFromThis());
+    REQUIRE(!cptr->TrySharedFromThis());
+    REQUIRE_THROWS_AS(ptr->SharedFromThis(), BadWeakPtr);
+
+    WeakPtr<T> weak;
+    static_assert(noexcept(weak.TryLock()), "Operation must be noexcept");
+    {
+        SharedPtr<T> s(ptr);
+        SharedPtr<T> from_this = ptr->TrySharedFromThis();
+        REQUIRE(from_this == s);
+        REQUIRE(s.UseCount() == 2);
+        SharedPtr<const T> const_from_this = cptr->TrySharedFromThis();
+        REQUIRE(const_from_this.Get() == ptr);
+        weak = s;
+        REQUIRE(weak.TryLock() == s);
+    }
+    REQUIRE(!weak.TryLock());
+}
+
+TEST_CASE("SharedFromThis layout") {
+    static_assert(sizeof(EnableSharedFromThis<T>) == sizeof(void*));
+    static_assert(sizeof(EnableSharedFromThis<Foo>) == sizeof(void*));
+
+    T t;
+    {
+        SharedPtr<T> first(&t, NullDeleter);
+        REQUIRE(t.SharedFromThis() == first);
+    }
+    REQUIRE(!t.TrySharedFromThis());
+    {
+        SharedPtr<T> second(&t, NullDeleter);
+        REQUIRE(t.SharedFromThis() == second);
+        REQUIRE(t.WeakFromThis().Lock() == second);
+    }
+}
+
+TEST_CASE("SharedFromThis through a virtual base") {
+    Bar* raw = new Bar(1);
+    REQUIRE(!raw->TrySharedFromThis());
+    REQUIRE(raw->WeakFromThis().Expired());
+
+    WeakPtr<Foo> weak;
+    {
+        SharedPtr<Bar> bar(raw);
+        SharedPtr<Foo> foo = raw->SharedFromThis();
+        REQUIRE(foo.Get() == static_cast<Foo*>(raw));
+        REQUIRE(bar.UseCount() == 2);
+        const Foo* const_foo = raw;
+        REQUIRE(const_foo->TrySharedFromThis().Get() == foo.Get());
+        weak = raw->WeakFromThis();
+        REQUIRE(weak.Lock() == foo);
+    }
+    REQUIRE(weak.Expired());
+}
+
 TEST_CASE("WeakFromThis") {
     T* ptr = new T;
     const T* cptr = ptr;
@@ -0,0 +1,71 @@
+// Built with -fno-exceptions -DSMART_PTR_NO_EXCEPTIONS (see CMakeLists.txt): the shared core
+// must compile without exceptions, and the Try* promotions report failures as empty pointers.
+// No Catch here, it needs exceptions.
+
+#include "shared.h"
+#include "weak.h"
+
+#include <intrusive/compressed.h>
+#include <intrusive/intrusive.h>
+
+#include <cstdio>
+
+namespace {
+
+struct Node : public EnableSharedFromThis<Node> {
+    int value = 0;
+};
+
+struct Counted : SimpleRefCounted<Counted> {
+    int value = 0;
+};
+
+struct NodeArena;
+using Arena = VirtualArena<NodeArena>;
+
+struct ArenaNode : SimpleRefCounted<ArenaNode, ArenaDelete<Arena>> {
+    int value = 0;
+};
+
+int failures = 0;
+
+void Check(bool condition, const char* what) {
+    if (!condition) {
+        std::fprintf(stderr, "failed: %s\n", what);
+        ++failures;
+    }
+}
+
+void NullDeleter(Node*) {
+}
+
+}  // namespace
+
+int main() {
+    Node unowned;
+    Check(!unowned.TrySharedFromThis(), "TrySharedFromThis of an unowned object");
+
+    WeakPtr<Node> weak;
+    {
+        SharedPtr<Node> node = MakeShared<Node>();
+        Check(node->TrySharedFromThis() == node, "TrySharedFromThis of an owned object");
+        Check(node->SharedFromThis() == node, "SharedFromThis of an owned object");
+        weak = node;
+        Check(weak.TryLock() == node, "TryLock of a live object");
+        Check(SharedPtr<Node>(weak) == node, "promotion of a live object");
+    }
+    Check(!weak.TryLock(), "TryLock of an expired object");
+
+    {
+        SharedPtr<Node> with_deleter(&unowned, NullDeleter);
+        Check(unowned.TrySharedFromThis() == with_deleter, "TrySharedFromThis with a deleter");
+    }
+
+    IntrusivePtr<Counted> counted = MakeIntrusive<Counted>();
+    Check(counted->RefCount() == 1, "MakeIntrusive");
+
+    auto compressed = MakeCompressedIntrusive<ArenaNode, Arena>();
+    Check(compressed.UseCount() == 1, "MakeCompressedIntrusive");
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,434 @@
+#include <common/bulk.h>
+#include <common/concurrent_map.h>
+#include <common/parallel_release.h>
+#include <common/prefetch.h>
+#include <common/shared_core.h>
+#include <common/snapshot.h>
+
+#include <catch.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// shared/: strong references only
+using StrongPlain = SharedPolicy<PlainCount, NoWeak, NoSharedFromThis, DefaultAllocation>;
+// weak/
+using WeakPlain = SharedPolicy<PlainCount, WithWeak, NoSharedFromThis, DefaultAllocation>;
+using StrongAtomic = SharedPolicy<AtomicCount, NoWeak, NoSharedFromThis, DefaultAllocation>;
+using WeakAtomic = SharedPolicy<AtomicCount, WithWeak, NoSharedFromThis, DefaultAllocation>;
+
+constexpr size_t kOwners = 1 << 16;
+
+// Copies one pointer into every slot and drops the copies again
+template <typename Ptr>
+size_t CopyRound(const Ptr& source, std::vector<Ptr>& slots) {
+    for (auto& slot : slots) {
+        slot = source;
+    }
+    for (auto& slot : slots) {
+        slot = Ptr();
+    }
+    return slots.size();
+}
+
+template <typename Policy>
+void BenchmarkConfiguration(const char* copies, const char* creation) {
+    using Ptr = BasicSharedPtr<int, Policy>;
+    auto source = MakeBasicShared<int, Policy>(42);
+    std::vector<Ptr> slots(kOwners);
+
+    BENCHMARK(copies) {
+        return CopyRound(source, slots);
+    };
+
+    BENCHMARK(creation) {
+        for (auto& slot : slots) {
+            slot = MakeBasicShared<int, Policy>(1);
+        }
+        slots.assign(kOwners, Ptr());
+        return slots.size();
+    };
+}
+
+}  // namespace
+
+TEST_CASE("Configurations", "[!benchmark]") {
+    BenchmarkConfiguration<StrongPlain>("strong, plain: 64K copies",
+                                        "strong, plain: 64K MakeShared");
+    BenchmarkConfiguration<WeakPlain>("weak, plain: 64K copies", "weak, plain: 64K MakeShared");
+    BenchmarkConfiguration<StrongAtomic>("strong, atomic: 64K copies",
+                                         "strong, atomic: 64K MakeShared");
+    BenchmarkConfiguration<WeakAtomic>("weak, atomic: 64K copies",
+                                       "weak, atomic: 64K MakeShared");
+
+    auto source = std::make_shared<int>(42);
+    std::vector<std::shared_ptr<int>> slots(kOwners);
+
+    BENCHMARK("std::shared_ptr: 64K copies") {
+        return CopyRound(source, slots);
+    };
+
+    BENCHMARK("std::shared_ptr: 64K make_shared") {
+        for (auto& slot : slots) {
+            slot = std::make_shared<int>(1);
+        }
+        slots.assign(kOwners, nullptr);
+        return slots.size();
+    };
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+template <typename Release>
+struct Tree {
+    using Policy = SharedPolicy<AtomicCount, NoWeak, NoSharedFromThis, DefaultAllocation, Release>;
+    using Ptr = BasicSharedPtr<Tree, Policy>;
+
+    static Ptr Make(int depth) {
+        auto node = MakeBasicShared<Tree, Policy>();
+        if (depth > 0) {
+            node->left = Make(depth - 1);
+            node->right = Make(depth - 1);
+        }
+        return node;
+    }
+
+    Ptr left;
+    Ptr right;
+    // Something for the destructor to free
+    std::vector<int> payload = std::vector<int>(8);
+};
+
+constexpr int kTreeDepth = 19;
+
+}  // namespace
+
+TEST_CASE("Parallel teardown", "[!benchmark]") {
+    using Serial = Tree<IterativeRelease>;
+    using Parallel = Tree<ParallelRelease>;
+
+    BENCHMARK_ADVANCED("1M nodes, one thread")(Catch::Benchmark::Chronometer meter) {
+        std::vector<Serial::Ptr> roots(meter.runs());
+        for (auto& root : roots) {
+            root = Serial::Make(kTreeDepth);
+        }
+        meter.measure([&](int i) { roots[i].Reset(); });
+    };
+
+    ParallelReleasePool pool;
+    BENCHMARK_ADVANCED("1M nodes, ParallelReleasePool")(Catch::Benchmark::Chronometer meter) {
+        std::vector<Parallel::Ptr> roots(meter.runs());
+        for (auto& root : roots) {
+            root = Parallel::Make(kTreeDepth);
+        }
+        meter.measure([&](int i) { pool.Release(std::move(roots[i])).wait(); });
+    };
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Item {
+    using Ptr = BasicSharedPtr<Item, StrongPlain>;
+
+    void Save(SnapshotWriter& writer) const {
+        writer.Write(id);
+        writer.Write(name);
+        writer.Write(category);
+        writer.Write(related);
+    }
+
+    void Load(SnapshotReader& reader) {
+        reader.Read(id);
+        reader.Read(name);
+        reader.Read(category);
+        reader.Read(related);
+    }
+
+    int id = 0;
+    std::string name;
+    Ptr category;
+    Ptr related;
+};
+
+// 100K items in 100 categories, each related to an earlier item
+std::vector<Item::Ptr> MakeCatalog() {
+    constexpr int kItems = 100'000;
+    constexpr int kCategories = 100;
+    std::vector<Item::Ptr> items;
+    items.reserve(kItems);
+    for (int i = 0; i < kItems; ++i) {
+        auto item = MakeBasicShared<Item, StrongPlain>();
+        item->id = i;
+        item->name = "catalog item number " + std::to_string(i);
+        if (i >= kCategories) {
+            item->category = items[i % kCategories];
+            item->related = items[i * 7919 % i];
+        }
+        items.push_back(std::move(item));
+    }
+    return items;
+}
+
+}  // namespace
+
+TEST_CASE("Snapshots", "[!benchmark]") {
+    auto items = MakeCatalog();
+    SnapshotWriter writer;
+    for (const auto& item : items) {
+        writer.Write(item);
+    }
+    auto bytes = std::move(writer).Finish();
+
+    BENCHMARK("100K items: build") {
+        return MakeCatalog().size();
+    };
+
+    BENCHMARK("100K items: write") {
+        SnapshotWriter writer;
+        for (const auto& item : items) {
+            writer.Write(item);
+        }
+        return std::move(writer).Finish().size();
+    };
+
+    BENCHMARK("100K items: restore") {
+        SnapshotReader reader(bytes);
+        std::vector<Item::Ptr> restored(items.size());
+        for (auto& item : restored) {
+            reader.Read(item);
+        }
+        return restored.size();
+    };
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// One cache line
+struct Record {
+    int64_t value;
+    int64_t padding[7];
+};
+
+// Pointers in random order, so that consecutive elements point to unrelated cache lines
+std::vector<BasicSharedPtr<Record, StrongPlain>> MakeScattered(size_t count) {
+    std::vector<BasicSharedPtr<Record, StrongPlain>> records;
+    records.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        Record record{static_cast<int64_t>(i), {}};
+        records.push_back(MakeBasicShared<Record, StrongPlain>(record));
+    }
+    std::shuffle(records.begin(), records.end(), std::mt19937(42));
+    return records;
+}
+
+// Some work per record, enough to fill the reorder window of the core
+uint64_t Mix(const Record& record) {
+    auto hash = static_cast<uint64_t>(record.value);
+    for (int i = 0; i < 24; ++i) {
+        hash = hash * 0x9e3779b97f4a7c15 + (hash >> 29);
+    }
+    return hash;
+}
+
+void BenchmarkDeref(size_t count, const std::string& name) {
+    auto records = MakeScattered(count);
+
+    BENCHMARK(name + ": plain loop") {
+        uint64_t sum = 0;
+        for (const auto& record : records) {
+            sum += Mix(*record);
+        }
+        return sum;
+    };
+
+    BENCHMARK(name + ": ForEachDeref") {
+        uint64_t sum = 0;
+        ForEachDeref(records, [&](const Record& record) { sum += Mix(record); });
+        return sum;
+    };
+
+    std::vector<BasicSharedPtr<Record, StrongPlain>> copies(count);
+    BENCHMARK(name + ": copy, plain loop") {
+        std::copy(records.begin(), records.end(), copies.begin());
+        return copies.size();
+    };
+
+    BENCHMARK(name + ": copy, ForEachPtr") {
+        auto out = copies.begin();
+        ForEachPtr(records, [&](const auto& record) { *out++ = record; });
+        return copies.size();
+    };
+}
+
+}  // namespace
+
+TEST_CASE("Prefetch", "[!benchmark]") {
+    // 1 MiB, 16 MiB and 128 MiB of records
+    BenchmarkDeref(1 << 14, "16K records");
+    BenchmarkDeref(1 << 18, "256K records");
+    BenchmarkDeref(1 << 21, "2M records");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// 90% of the elements on 16 interned objects, the rest spread over 4K others
+template <typename Policy>
+std::vector<BasicSharedPtr<int, Policy>> MakeSkewed(size_t count) {
+    std::vector<BasicSharedPtr<int, Policy>> hot, cold;
+    for (int i = 0; i < 16; ++i) {
+        hot.push_back(MakeBasicShared<int, Policy>(i));
+    }
+    for (int i = 0; i < 4096; ++i) {
+        cold.push_back(MakeBasicShared<int, Policy>(i));
+    }
+    std::mt19937 random(42);
+    std::vector<BasicSharedPtr<int, Policy>> values;
+    values.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (random() % 10 != 0) {
+            values.push_back(hot[random() % hot.size()]);
+        } else {
+            values.push_back(cold[random() % cold.size()]);
+        }
+    }
+    return values;
+}
+
+template <typename Policy>
+void BenchmarkBulk(const std::string& name) {
+    auto values = MakeSkewed<Policy>(10'000'000);
+    std::vector<BasicSharedPtr<int, Policy>> copies;
+    copies.reserve(values.size());
+
+    BENCHMARK(name + ": copy and reset one by one") {
+        std::copy(values.begin(), values.end(), std::back_inserter(copies));
+        for (auto& copy : copies) {
+            copy.Reset();
+        }
+        copies.clear();
+        return values.size();
+    };
+
+    BENCHMARK(name + ": CopyAll and ReleaseAll") {
+        CopyAll(values, std::back_inserter(copies));
+        ReleaseAll(copies);
+        copies.clear();
+        return values.size();
+    };
+}
+
+}  // namespace
+
+TEST_CASE("Bulk reference counts", "[!benchmark]") {
+    BenchmarkBulk<StrongPlain>("10M skewed, plain");
+    BenchmarkBulk<StrongAtomic>("10M skewed, atomic");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+constexpr int kMapKeys = 4096;
+constexpr size_t kReadsPerThread = 1 << 20;
+
+using MapValue = BasicSharedPtr<const int, StrongAtomic>;
+
+// The usual alternative: one lock, and every read copies the pointer out
+class LockedMap {
+public:
+    void InsertOrAssign(int key, MapValue value) {
+        std::lock_guard lock(mutex_);
+        map_[key] = std::move(value);
+    }
+
+    MapValue Get(int key) const {
+        std::lock_guard lock(mutex_);
+        auto it = map_.find(key);
+        return it != map_.end() ? it->second : MapValue();
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::unordered_map<int, MapValue> map_;
+};
+
+// `readers` threads do kReadsPerThread lookups each while one thread keeps replacing values
+template <typename Map, typename Read>
+size_t ReadDuringUpdates(Map& map, size_t readers, Read read) {
+    std::atomic<bool> done = false;
+    std::thread writer([&] {
+        for (int i = 0; !done.load(std::memory_order_relaxed); ++i) {
+            map.InsertOrAssign(i % kMapKeys, MakeBasicShared<const int, StrongAtomic>(i));
+        }
+    });
+    std::vector<std::thread> threads;
+    std::atomic<size_t> sum = 0;
+    for (size_t t = 0; t < readers; ++t) {
+        threads.emplace_back([&, t] {
+            size_t local = 0;
+            for (size_t i = 0; i < kReadsPerThread; ++i) {
+                local += read(map, static_cast<int>((i * 7 + t) % kMapKeys));
+            }
+            sum += local;
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    done = true;
+    writer.join();
+    return sum;
+}
+
+void BenchmarkMaps(size_t readers) {
+    std::string name = std::to_string(readers) + " readers, 1M reads each";
+
+    LockedMap locked;
+    ConcurrentMap<int, int, StrongAtomic> concurrent;
+    for (int key = 0; key < kMapKeys; ++key) {
+        locked.InsertOrAssign(key, MakeBasicShared<const int, StrongAtomic>(key));
+        concurrent.InsertOrAssign(key, MakeBasicShared<const int, StrongAtomic>(key));
+    }
+
+    BENCHMARK(name + ": mutex + unordered_map, copying Get") {
+        return ReadDuringUpdates(locked, readers, [](const LockedMap& map, int key) {
+            MapValue value = map.Get(key);
+            return value ? static_cast<size_t>(*value) : 0;
+        });
+    };
+
+    BENCHMARK(name + ": ConcurrentMap, borrowed Find") {
+        return ReadDuringUpdates(concurrent, readers, [](const auto& map, int key) {
+            EpochGuard guard;
+            auto value = map.Find(key, guard);
+            return value ? static_cast<size_t>(*value) : 0;
+        });
+    };
+}
+
+}  // namespace
+
+TEST_CASE("Concurrent map reads", "[!benchmark]") {
+    BenchmarkMaps(1);
+    BenchmarkMaps(4);
+}
@@ -1,11 +1,12 @@
 #pragma once
 
-#include <exception>
+#include <common/shared_fwd.h>
 
-class BadWeakPtr : public std::exception {};
+// Strong references only, not thread-safe: the cheapest configuration
+using SharedConfig = SharedPolicy<PlainCount, NoWeak, NoSharedFromThis, DefaultAllocation>;
 
 template <typename T>
-class SharedPtr;
+using SharedPtr = BasicSharedPtr<T, SharedConfig>;
 
 template <typename T>
-class WeakPtr;
+using WeakPtr = BasicWeakPtr<T, SharedConfig>;
@@ -1,10 +1,30 @@
 #include "shared.h"
 
+#include <common/bulk.h>
+#include <common/concurrent_map.h>
+#include <common/epoch.h>
+#include <common/parallel_release.h>
+#include <common/prefetch.h>
+#include <common/snapshot.h>
+
+#include <unique/unique.h>
+
 #include <catch.hpp>
 
 #include "allocations_checker.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <list>
 #include <memory>
+#include <new>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -467,3 +487,855 @@ TEST_CASE("Destructor for correct type") {
         REQUIRE(B::destructor_called);
     }
 }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct CountingDeleter {
+    int* calls;
+
+    void operator()(std::string* ptr) {
+        ++*calls;
+        delete ptr;
+    }
+};
+
+// Hands out slots of a fixed array; the objects are constructed in place by the caller
+struct IntPool {
+    alignas(int) std::byte slots[4][sizeof(int)];
+    bool used[4] = {};
+
+    int* Acquire(int value) {
+        for (int i = 0; i < 4; ++i) {
+            if (!used[i]) {
+                used[i] = true;
+                return new (slots[i]) int(value);
+            }
+        }
+        return nullptr;
+    }
+
+    size_t InUse() const {
+        return std::count(std::begin(used), std::end(used), true);
+    }
+};
+
+struct PoolDeleter {
+    IntPool* pool;
+
+    void operator()(int* ptr) {
+        pool->used[(reinterpret_cast<std::byte*>(ptr) - pool->slots[0]) / sizeof(int)] = false;
+    }
+};
+
+TEST_CASE("From UniquePtr") {
+    SECTION("Adopts the object and the deleter") {
+        int calls = 0;
+        UniquePtr<std::string, CountingDeleter> u(new std::string("abc"), {&calls});
+        std::string* raw = u.Get();
+
+        SharedPtr<std::string> a(std::move(u));
+        REQUIRE(u.Get() == nullptr);
+        REQUIRE(a.Get() == raw);
+        REQUIRE(a.UseCount() == 1);
+
+        SharedPtr<std::string> b = a;
+        a.Reset();
+        REQUIRE(calls == 0);
+        b.Reset();
+        REQUIRE(calls == 1);
+    }
+
+    SECTION("One allocation") {
+        auto u = MakeUnique<std::string>("abc");
+        EXPECT_ONE_ALLOCATION(SharedPtr<std::string> a(std::move(u)));
+    }
+
+    SECTION("Empty") {
+        UniquePtr<int> u;
+        EXPECT_ZERO_ALLOCATIONS(SharedPtr<int> a(std::move(u)); REQUIRE(!a));
+    }
+
+    SECTION("Destructor for correct type") {
+        B::destructor_called = false;
+        {
+            SharedPtr<A> a(MakeUnique<B>());
+        }
+        REQUIRE(B::destructor_called);
+    }
+
+    SECTION("Pool storage") {
+        IntPool pool;
+        {
+            SharedPtr<int> a;
+            EXPECT_ONE_ALLOCATION(a = SharedPtr<int>(pool.Acquire(5), PoolDeleter{&pool}));
+            SharedPtr<int> b(pool.Acquire(6), PoolDeleter{&pool});
+            REQUIRE(*a + *b == 11);
+            REQUIRE(pool.InUse() == 2);
+        }
+        REQUIRE(pool.InUse() == 0);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <typename Release>
+struct ChainNode {
+    using Policy = SharedPolicy<PlainCount, NoWeak, NoSharedFromThis, DefaultAllocation, Release>;
+
+    BasicSharedPtr<ChainNode, Policy> next;
+
+    ~ChainNode() {
+        ++destroyed;
+    }
+
+    inline static size_t destroyed = 0;
+};
+
+template <typename Release>
+BasicSharedPtr<ChainNode<Release>, typename ChainNode<Release>::Policy> MakeChain(size_t length) {
+    using Node = ChainNode<Release>;
+    BasicSharedPtr<Node, typename Node::Policy> head;
+    for (size_t i = 0; i < length; ++i) {
+        auto node = MakeBasicShared<Node, typename Node::Policy>();
+        node->next = std::move(head);
+        head = std::move(node);
+    }
+    return head;
+}
+
+TEST_CASE("Release policies") {
+    SECTION("Iterative release of a long chain") {
+        using Node = ChainNode<IterativeRelease>;
+        constexpr size_t kLength = 1'000'000;
+        auto head = MakeChain<IterativeRelease>(kLength);
+        Node::destroyed = 0;
+
+        head.Reset();
+        REQUIRE(Node::destroyed == kLength);
+    }
+
+    SECTION("Incremental release") {
+        using Node = ChainNode<IncrementalRelease>;
+        auto& reclaimer = IncrementalReclaimer::Local();
+        auto head = MakeChain<IncrementalRelease>(100);
+        Node::destroyed = 0;
+
+        head.Reset();
+        REQUIRE(Node::destroyed == 0);
+        REQUIRE(reclaimer.Pending() == 1);
+
+        size_t steps = 0;
+        while (reclaimer.Pending() > 0) {
+            REQUIRE(reclaimer.Step(30) <= 30);
+            ++steps;
+        }
+        REQUIRE(Node::destroyed == 100);
+        REQUIRE(steps == 4);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct TreeNode {
+    using Policy = SharedPolicy<AtomicCount, NoWeak, NoSharedFromThis, DefaultAllocation,
+                                ParallelRelease>;
+    using Ptr = BasicSharedPtr<TreeNode, Policy>;
+
+    Ptr left;
+    Ptr right;
+
+    ~TreeNode() {
+        destroyed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline static std::atomic<size_t> destroyed = 0;
+};
+
+// A full binary tree whose left and right subtrees share a common leaf
+TreeNode::Ptr MakeTree(int depth, const TreeNode::Ptr& shared_leaf) {
+    auto node = MakeBasicShared<TreeNode, TreeNode::Policy>();
+    if (depth > 0) {
+        node->left = MakeTree(depth - 1, shared_leaf);
+        node->right = MakeTree(depth - 1, shared_leaf);
+    } else {
+        node->left = shared_leaf;
+    }
+    return node;
+}
+
+TEST_CASE("ParallelRelease") {
+    constexpr int kDepth = 15;
+    // The tree and the shared leaf
+    constexpr size_t kNodes = size_t{2} << kDepth;
+    ParallelReleasePool pool(4);
+    TreeNode::destroyed = 0;
+
+    SECTION("Whole tree") {
+        auto root = MakeTree(kDepth, MakeBasicShared<TreeNode, TreeNode::Policy>());
+        auto done = pool.Release(std::move(root));
+        REQUIRE(root.Get() == nullptr);
+        done.wait();
+        REQUIRE(TreeNode::destroyed == kNodes);
+    }
+
+    SECTION("Several roots") {
+        std::vector<std::future<void>> done;
+        for (int i = 0; i < 8; ++i) {
+            done.push_back(pool.Release(MakeTree(10, nullptr)));
+        }
+        for (auto& future : done) {
+            future.wait();
+        }
+        REQUIRE(TreeNode::destroyed == 8 * ((size_t{2} << 10) - 1));
+    }
+
+    SECTION("Subtree kept alive") {
+        auto root = MakeTree(kDepth, nullptr);
+        auto kept = root->left;
+        pool.Release(std::move(root)).wait();
+        REQUIRE(TreeNode::destroyed == (size_t{1} << kDepth));
+        REQUIRE(kept.UseCount() == 1);
+    }
+
+    SECTION("Outside the pool") {
+        auto root = MakeTree(10, nullptr);
+        root.Reset();
+        REQUIRE(TreeNode::destroyed == (size_t{2} << 10) - 1);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct GraphNode {
+    explicit GraphNode(int* destroyed = nullptr) : destroyed(destroyed) {
+    }
+
+    ~GraphNode() {
+        if (destroyed) {
+            ++*destroyed;
+        }
+    }
+
+    void Traverse(GcVisitor& visitor) {
+        for (const auto& edge : edges) {
+            visitor.Visit(edge);
+        }
+    }
+
+    std::vector<SharedPtr<GraphNode>> edges;
+    int* destroyed;
+};
+
+struct Untraced {
+    SharedPtr<Untraced> self;
+};
+
+TEST_CASE("Cycle collection") {
+    int destroyed = 0;
+
+    SECTION("Parent and child") {
+        auto parent = MakeShared<GraphNode>(&destroyed);
+        auto child = MakeShared<GraphNode>(&destroyed);
+        parent->edges.push_back(child);
+        child->edges.push_back(parent);
+        child.Reset();
+        parent.Reset();
+        REQUIRE(destroyed == 0);
+
+        CycleStats stats = CollectCycles();
+        REQUIRE(destroyed == 2);
+        REQUIRE(stats.objects == 2);
+        REQUIRE(stats.bytes >= 2 * sizeof(GraphNode));
+        REQUIRE(CollectCycles().objects == 0);
+    }
+
+    SECTION("Reachable cycles stay") {
+        auto a = MakeShared<GraphNode>(&destroyed);
+        auto b = MakeShared<GraphNode>(&destroyed);
+        auto tail = MakeShared<GraphNode>(&destroyed);
+        a->edges.push_back(b);
+        b->edges.push_back(a);
+        b->edges.push_back(tail);
+        auto keep = tail;
+        b.Reset();
+
+        REQUIRE(CollectCycles().objects == 0);
+        REQUIRE(destroyed == 0);
+
+        a.Reset();
+        tail.Reset();
+        REQUIRE(CollectCycles().objects == 2);
+        REQUIRE(destroyed == 2);
+        REQUIRE(keep.UseCount() == 1);
+    }
+
+    SECTION("Self reference") {
+        auto node = MakeShared<GraphNode>(&destroyed);
+        node->edges.push_back(node);
+        node->edges.push_back(MakeShared<GraphNode>(&destroyed));
+        SharedPtr<GraphNode> adopted(new GraphNode(&destroyed));
+        node->edges.push_back(adopted);
+        adopted.Reset();
+        node.Reset();
+
+        // Everything only the cycle can reach goes with it
+        REQUIRE(CollectCycles().objects == 3);
+        REQUIRE(destroyed == 3);
+    }
+
+    SECTION("Long ring") {
+        auto first = MakeShared<GraphNode>(&destroyed);
+        auto last = first;
+        for (int i = 1; i < 1000; ++i) {
+            auto next = MakeShared<GraphNode>(&destroyed);
+            last->edges.push_back(next);
+            last = next;
+        }
+        last->edges.push_back(first);
+        first.Reset();
+        last.Reset();
+
+        REQUIRE(CollectCycles().objects == 1000);
+        REQUIRE(destroyed == 1000);
+    }
+
+    SECTION("Candidates destroyed on another thread") {
+        auto node = MakeShared<GraphNode>(&destroyed);
+        auto copy = node;
+        copy.Reset();
+        REQUIRE(CycleCollector<SharedConfig>::Local().Candidates() == 1);
+
+        std::thread([node = std::move(node)]() mutable { node.Reset(); }).join();
+        REQUIRE(destroyed == 1);
+        REQUIRE(CycleCollector<SharedConfig>::Local().Candidates() == 0);
+        REQUIRE(CollectCycles().objects == 0);
+    }
+
+    SECTION("Candidates of a thread that has exited") {
+        auto node = MakeShared<GraphNode>(&destroyed);
+        std::thread([&node] {
+            auto copy = node;
+            copy.Reset();
+            REQUIRE(CycleCollector<SharedConfig>::Local().Candidates() == 1);
+        }).join();
+
+        REQUIRE(CycleCollector<SharedConfig>::Local().Candidates() == 0);
+        node.Reset();
+        REQUIRE(destroyed == 1);
+
+        // A cycle tracked on a thread that is gone is tracked again by the next release
+        auto a = MakeShared<GraphNode>(&destroyed);
+        auto b = MakeShared<GraphNode>(&destroyed);
+        a->edges.push_back(b);
+        b->edges.push_back(a);
+        std::thread([&a] {
+            auto copy = a;
+            copy.Reset();
+        }).join();
+        a.Reset();
+        b.Reset();
+        REQUIRE(CollectCycles().objects == 2);
+        REQUIRE(destroyed == 3);
+    }
+
+    SECTION("References released after the collector of the thread") {
+        std::thread([&destroyed] {
+            // Constructed before the collector, so destroyed after it
+            thread_local SharedPtr<GraphNode> first;
+            thread_local SharedPtr<GraphNode> second;
+            first = MakeShared<GraphNode>(&destroyed);
+            second = first;
+            auto copy = first;
+            copy.Reset();
+            REQUIRE(CycleCollector<SharedConfig>::Local().Candidates() == 1);
+        }).join();
+        REQUIRE(destroyed == 1);
+    }
+
+    SECTION("Types without Traverse are not tracked") {
+        static_assert(!kIsTraversable<Untraced>);
+        auto node = MakeShared<Untraced>();
+        node->self = node;
+        auto copy = node;
+        copy.Reset();
+        REQUIRE(CycleCollector<SharedConfig>::Local().Candidates() == 0);
+        REQUIRE(CollectCycles().objects == 0);
+        node->self.Reset();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct CatalogItem {
+    void Save(SnapshotWriter& writer) const {
+        writer.Write(id);
+        writer.Write(name);
+        writer.Write(parent);
+        writer.Write(related);
+    }
+
+    void Load(SnapshotReader& reader) {
+        reader.Read(id);
+        reader.Read(name);
+        reader.Read(parent);
+        reader.Read(related);
+    }
+
+    int id = 0;
+    std::string name;
+    SharedPtr<CatalogItem> parent;
+    SharedPtr<CatalogItem> related;
+};
+
+SharedPtr<CatalogItem> MakeItem(int id, SharedPtr<CatalogItem> parent) {
+    auto item = MakeShared<CatalogItem>();
+    item->id = id;
+    item->name = "item " + std::to_string(id);
+    item->parent = std::move(parent);
+    return item;
+}
+
+struct ChainLink {
+    void Save(SnapshotWriter& writer) const {
+        writer.Write(value);
+        writer.Write(next);
+    }
+
+    void Load(SnapshotReader& reader) {
+        reader.Read(value);
+        reader.Read(next);
+    }
+
+    int value = 0;
+    SharedPtr<ChainLink> next;
+};
+
+// Releasing a long chain from the front would recurse through every link
+void Unchain(SharedPtr<ChainLink>& head) {
+    while (head) {
+        head = std::move(head->next);
+    }
+}
+
+TEST_CASE("Snapshots") {
+    auto root = MakeItem(1, nullptr);
+    auto a = MakeItem(2, root);
+    auto b = MakeItem(3, root);
+    a->related = b;
+    b->related = b;
+
+    SnapshotWriter writer;
+    writer.Write(a);
+    writer.Write(b);
+    writer.Write(SharedPtr<CatalogItem>());
+    auto bytes = std::move(writer).Finish();
+
+    SECTION("Sharing survives") {
+        SharedPtr<CatalogItem> a2, b2, none;
+        {
+            SnapshotReader reader(bytes);
+            reader.Read(a2);
+            reader.Read(b2);
+            reader.Read(none);
+            REQUIRE(reader.AtEnd());
+        }
+        REQUIRE(!none);
+        REQUIRE(a2->id == 2);
+        REQUIRE(a2->name == "item 2");
+        REQUIRE(b2->name == "item 3");
+        REQUIRE(a2->related == b2);
+        REQUIRE(b2->related == b2);
+        REQUIRE(a2->parent == b2->parent);
+        REQUIRE(a2->parent->name == "item 1");
+        REQUIRE(!a2->parent->parent);
+        REQUIRE(a2->parent.UseCount() == 2);
+        REQUIRE(a2.UseCount() == 1);
+
+        b2->related.Reset();
+    }
+
+    SECTION("Memory-mapped file") {
+        const char* path = "snapshot_test.bin";
+        std::ofstream(path, std::ios::binary)
+            .write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        SharedPtr<CatalogItem> a2;
+        {
+            MappedSnapshot file(path);
+            SnapshotReader reader(file.Bytes());
+            reader.Read(a2);
+        }
+        std::remove(path);
+        REQUIRE(a2->related->parent == a2->parent);
+        a2->related->related.Reset();
+    }
+
+    SECTION("Malformed input") {
+        REQUIRE_THROWS_AS(SnapshotReader(std::span(bytes).first(4)), SnapshotError);
+
+        // Cuts into the last field of the first root
+        constexpr size_t kTwoReferences = 16;
+        auto truncated = std::span(bytes).first(bytes.size() - kTwoReferences - 1);
+        SnapshotReader reader(truncated);
+        SharedPtr<CatalogItem> item;
+        REQUIRE_THROWS_AS(reader.Read(item), SnapshotError);
+    }
+
+    SECTION("Back-references are type-checked") {
+        SnapshotReader reader(bytes);
+        SharedPtr<CatalogItem> a2;
+        reader.Read(a2);
+        SharedPtr<ChainLink> wrong;
+        REQUIRE_THROWS_AS(reader.Read(wrong), SnapshotError);
+        a2->related->related.Reset();
+    }
+
+    SECTION("Long chains") {
+        constexpr int kLength = 1 << 20;
+        SharedPtr<ChainLink> head;
+        for (int i = 0; i < kLength; ++i) {
+            auto link = MakeShared<ChainLink>();
+            link->value = i;
+            link->next = std::move(head);
+            head = std::move(link);
+        }
+        SnapshotWriter chain_writer;
+        chain_writer.Write(head);
+        auto chain = std::move(chain_writer).Finish();
+        Unchain(head);
+
+        SharedPtr<ChainLink> restored;
+        {
+            SnapshotReader reader(chain);
+            reader.Read(restored);
+            REQUIRE(reader.AtEnd());
+        }
+        int length = 0;
+        bool ordered = true;
+        for (ChainLink* link = restored.Get(); link; link = link->next.Get()) {
+            ordered = ordered && link->value == kLength - 1 - length;
+            ++length;
+        }
+        REQUIRE(length == kLength);
+        REQUIRE(ordered);
+        Unchain(restored);
+    }
+
+    SECTION("Aliasing pointers are rejected") {
+        SnapshotWriter aliasing;
+        aliasing.Write(a);
+        REQUIRE_THROWS_AS(aliasing.Write(SharedPtr<CatalogItem>(a, a->parent.Get())),
+                          SnapshotError);
+    }
+
+    b->related.Reset();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("ForEachDeref") {
+    std::vector<SharedPtr<int>> values;
+    for (int i = 0; i < 100; ++i) {
+        values.push_back(i % 10 == 0 ? nullptr : MakeShared<int>(i));
+    }
+
+    SECTION("Skips null pointers") {
+        int sum = 0;
+        int calls = 0;
+        ForEachDeref(values, [&](int value) {
+            sum += value;
+            ++calls;
+        });
+        REQUIRE(calls == 90);
+        REQUIRE(sum == 4950 - 450);
+    }
+
+    SECTION("Distances and short ranges") {
+        for (size_t distance : {0, 1, 16, 1000}) {
+            int sum = 0;
+            ForEachDeref(values, [&](int value) { sum += value; }, distance);
+            REQUIRE(sum == 4500);
+        }
+        std::list<SharedPtr<int>> one = {MakeShared<int>(7)};
+        int seen = 0;
+        ForEachDeref(one, [&](int value) { seen = value; });
+        REQUIRE(seen == 7);
+    }
+
+    SECTION("Copying the pointers") {
+        std::vector<SharedPtr<int>> copies;
+        ForEachPtr(values, [&](const SharedPtr<int>& ptr) { copies.push_back(ptr); });
+        REQUIRE(copies.size() == values.size());
+        REQUIRE(values[1].UseCount() == 2);
+
+        ForEachPtr(copies, [](SharedPtr<int>& ptr) { ptr.Reset(); });
+        REQUIRE(values[1].UseCount() == 1);
+    }
+
+    SECTION("Raw pointers") {
+        std::vector<const int*> raw;
+        for (const auto& value : values) {
+            raw.push_back(value.Get());
+        }
+        int sum = 0;
+        ForEachDeref(raw, [&](int value) { sum += value; });
+        REQUIRE(sum == 4500);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Counted {
+    ~Counted() {
+        ++destroyed;
+    }
+
+    inline static int destroyed = 0;
+};
+
+// Appends to `out` and throws std::bad_alloc once it holds `limit` elements
+template <typename T>
+class LimitedInserter {
+public:
+    using iterator_category = std::output_iterator_tag;
+    using value_type = void;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = void;
+
+    LimitedInserter(std::vector<T>& out, size_t limit) : out_(&out), limit_(limit) {
+    }
+
+    LimitedInserter& operator=(T value) {
+        if (out_->size() == limit_) {
+            throw std::bad_alloc();
+        }
+        out_->push_back(std::move(value));
+        return *this;
+    }
+
+    LimitedInserter& operator*() {
+        return *this;
+    }
+
+    LimitedInserter& operator++() {
+        return *this;
+    }
+
+private:
+    std::vector<T>* out_;
+    size_t limit_;
+};
+
+template <typename Policy>
+void CheckBulkCounts() {
+    using Ptr = BasicSharedPtr<Counted, Policy>;
+
+    // More blocks than the table of pending updates has slots, most elements on a few of them
+    constexpr int kBlocks = 1000;
+    std::vector<Ptr> blocks;
+    for (int i = 0; i < kBlocks; ++i) {
+        blocks.push_back(MakeBasicShared<Counted, Policy>());
+    }
+    std::vector<Ptr> values;
+    for (int i = 0; i < 10'000; ++i) {
+        values.push_back(i % 7 == 0 ? Ptr() : blocks[i % 10 == 0 ? i % kBlocks : i % 3]);
+    }
+    std::vector<size_t> expected;
+    for (const auto& block : blocks) {
+        expected.push_back(block.UseCount());
+    }
+
+    std::vector<Ptr> copies;
+    CopyAll(values, std::back_inserter(copies));
+    REQUIRE(copies.size() == values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        REQUIRE(copies[i].Get() == values[i].Get());
+    }
+    for (int i = 0; i < kBlocks; ++i) {
+        REQUIRE(blocks[i].UseCount() == 2 * expected[i] - 1);
+    }
+
+    ReleaseAll(copies);
+    REQUIRE(std::all_of(copies.begin(), copies.end(), [](const Ptr& ptr) { return !ptr; }));
+    for (int i = 0; i < kBlocks; ++i) {
+        REQUIRE(blocks[i].UseCount() == expected[i]);
+    }
+
+    // Output into an existing range
+    copies.resize(3);
+    auto values_head = std::span(values).first(3);
+    REQUIRE(CopyAll(values_head, copies.begin()) == copies.end());
+    REQUIRE(blocks[1].UseCount() == expected[1] + 1);
+    copies.clear();
+
+    // An output that throws drops only references that were counted
+    REQUIRE_THROWS_AS(CopyAll(values, LimitedInserter<Ptr>(copies, 5'000)), std::bad_alloc);
+    REQUIRE(copies.size() == 5'000);
+    copies.clear();
+    for (int i = 0; i < kBlocks; ++i) {
+        REQUIRE(blocks[i].UseCount() == expected[i]);
+    }
+
+    std::vector<Ptr> lone{MakeBasicShared<Counted, Policy>()};
+    Counted::destroyed = 0;
+    REQUIRE_THROWS_AS(CopyAll(lone, LimitedInserter<Ptr>(copies, 0)), std::bad_alloc);
+    REQUIRE(Counted::destroyed == 0);
+    REQUIRE(lone[0].UseCount() == 1);
+
+    // Copying a range onto itself
+    REQUIRE(CopyAll(values, values.begin()) == values.end());
+    for (int i = 0; i < kBlocks; ++i) {
+        REQUIRE(blocks[i].UseCount() == expected[i]);
+    }
+
+    // The last owners are released once
+    Counted::destroyed = 0;
+    blocks.clear();
+    ReleaseAll(values);
+    REQUIRE(Counted::destroyed == kBlocks);
+}
+
+TEST_CASE("Bulk reference counts") {
+    using AtomicPolicy = SharedPolicy<AtomicCount, NoWeak, NoSharedFromThis, DefaultAllocation>;
+    static_assert(BulkCounts<BasicSharedPtr<int, AtomicPolicy>>::kCoalesce);
+    static_assert(!BulkCounts<SharedPtr<int>>::kCoalesce);
+
+    SECTION("Atomic counts") {
+        CheckBulkCounts<AtomicPolicy>();
+    }
+
+    SECTION("Plain counts") {
+        CheckBulkCounts<SharedConfig>();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Versioned {
+    Versioned(int key, int version) : key(key), mirror(~key), version(version) {
+        created.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ~Versioned() {
+        mirror = key;
+        destroyed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool Valid(int expected_key) const {
+        return key == expected_key && mirror == ~key;
+    }
+
+    int key;
+    int mirror;
+    int version;
+
+    inline static std::atomic<int> created = 0;
+    inline static std::atomic<int> destroyed = 0;
+};
+
+TEST_CASE("ConcurrentMap") {
+    using Policy = SharedPolicy<AtomicCount, NoWeak, NoSharedFromThis, DefaultAllocation>;
+    using Map = ConcurrentMap<int, Versioned, Policy>;
+    auto make = [](int key, int version) {
+        return MakeBasicShared<Versioned, Policy>(key, version);
+    };
+    EpochReclaimer::Drain();
+    Versioned::created = 0;
+    Versioned::destroyed = 0;
+
+    SECTION("Borrowed values") {
+        Map map(4);
+        for (int i = 0; i < 1000; ++i) {
+            REQUIRE(map.Insert(i, make(i, 0)));
+        }
+        REQUIRE(!map.Insert(7, make(7, 1)));
+        REQUIRE(!map.InsertOrAssign(7, make(7, 2)));
+        REQUIRE(map.Size() == 1000);
+
+        Map::Value owner;
+        {
+            EpochGuard guard;
+            Map::Borrowed borrowed = map.Find(7, guard);
+            REQUIRE(borrowed->version == 2);
+            REQUIRE(map.Get(7).UseCount() == 2);
+            REQUIRE(!map.Find(1000, guard));
+
+            // Erased, but still readable until the guard is gone
+            REQUIRE(map.Erase(7));
+            REQUIRE(!map.Erase(7));
+            REQUIRE(!map.Find(7, guard));
+            for (int i = 0; i < 10; ++i) {
+                EpochReclaimer::Collect();
+            }
+            REQUIRE(borrowed->Valid(7));
+            owner = borrowed.Lock();
+        }
+        // Versions 1 (never inserted) and 0 (replaced) are gone, 2 lives on in `owner`
+        EpochReclaimer::Drain();
+        REQUIRE(Versioned::destroyed == 2);
+        REQUIRE(owner->Valid(7));
+        REQUIRE(owner.UseCount() == 1);
+        owner.Reset();
+        REQUIRE(Versioned::destroyed == 3);
+
+        int visited = -1;
+        REQUIRE(map.Visit(999, [&](const Versioned& value) { visited = value.key; }));
+        REQUIRE(visited == 999);
+        REQUIRE(!map.Visit(7, [](const Versioned&) {}));
+    }
+
+    SECTION("Readers during updates") {
+        constexpr int kKeys = 256;
+        {
+            Map map(8);
+            for (int i = 0; i < kKeys; ++i) {
+                map.Insert(i, make(i, 0));
+            }
+
+            std::atomic<bool> stop = false;
+            std::atomic<int> errors = 0;
+            std::vector<std::thread> readers;
+            for (int t = 0; t < 3; ++t) {
+                readers.emplace_back([&, t] {
+                    for (int i = t; !stop.load(std::memory_order_relaxed); i = (i + 7) % kKeys) {
+                        EpochGuard guard;
+                        Map::Borrowed value = map.Find(i, guard);
+                        if (value && !value->Valid(i)) {
+                            errors.fetch_add(1);
+                        }
+                        if (i % 5 == 0) {
+                            auto owner = map.Get(i);
+                            if (owner && !owner->Valid(i)) {
+                                errors.fetch_add(1);
+                            }
+                        }
+                    }
+                });
+            }
+
+            std::thread writer([&] {
+                for (int version = 1; version <= 20'000; ++version) {
+                    int key = version % kKeys;
+                    if (version % 11 == 0) {
+                        map.Erase(key);
+                    } else {
+                        map.InsertOrAssign(key, make(key, version));
+                    }
+                    // New keys make the shards grow while the readers are on them
+                    map.Insert(kKeys + version, make(kKeys + version, 0));
+                }
+                stop = true;
+            });
+
+            writer.join();
+            for (auto& reader : readers) {
+                reader.join();
+            }
+            REQUIRE(errors == 0);
+            EpochReclaimer::Drain();
+            REQUIRE(Versioned::destroyed == Versioned::created - static_cast<int>(map.Size()));
+        }
+        EpochReclaimer::Drain();
+        REQUIRE(Versioned::destroyed == Versioned::created);
+    }
+}
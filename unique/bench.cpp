@@ -0,0 +1,94 @@
+#include "unique.h"
+
+#include <common/relocating_vector.h>
+
+#include <catch.hpp>
+
+#include <sys/resource.h>
+
+#include <cstring>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+constexpr size_t kScratchSize = 64 << 20;
+constexpr size_t kGrowthCount = 10'000'000;
+
+long MinorFaults() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+template <typename Factory>
+long FaultsOf(Factory make) {
+    long before = MinorFaults();
+    {
+        auto buffer = make();
+        buffer[0] = 1;
+        Catch::Benchmark::keep_memory(buffer.Get());
+    }
+    return MinorFaults() - before;
+}
+
+}  // namespace
+
+TEST_CASE("Scratch buffer page faults", "[!benchmark]") {
+    long zeroed = FaultsOf([] { return MakeUnique<char[]>(kScratchSize); });
+    long untouched = FaultsOf([] { return MakeUniqueForOverwrite<char[]>(kScratchSize); });
+
+    WARN("MakeUnique<char[]>(64MB): " << zeroed << " minor faults");
+    WARN("MakeUniqueForOverwrite<char[]>(64MB): " << untouched << " minor faults");
+    REQUIRE(untouched < zeroed);
+}
+
+TEST_CASE("Scratch buffer allocation", "[!benchmark]") {
+    BENCHMARK("MakeUnique<char[]>(64MB)") {
+        auto buffer = MakeUnique<char[]>(kScratchSize);
+        Catch::Benchmark::keep_memory(buffer.Get());
+        return buffer[0];
+    };
+
+    BENCHMARK("MakeUniqueForOverwrite<char[]>(64MB)") {
+        auto buffer = MakeUniqueForOverwrite<char[]>(kScratchSize);
+        Catch::Benchmark::keep_memory(buffer.Get());
+        buffer[0] = 0;
+        return buffer[0];
+    };
+
+    BENCHMARK("MakeUnique<char[]>(64MB) + overwrite") {
+        auto buffer = MakeUnique<char[]>(kScratchSize);
+        std::memset(buffer.Get(), 1, kScratchSize);
+        Catch::Benchmark::keep_memory(buffer.Get());
+        return buffer[kScratchSize - 1];
+    };
+
+    BENCHMARK("MakeUniqueForOverwrite<char[]>(64MB) + overwrite") {
+        auto buffer = MakeUniqueForOverwrite<char[]>(kScratchSize);
+        std::memset(buffer.Get(), 1, kScratchSize);
+        Catch::Benchmark::keep_memory(buffer.Get());
+        return buffer[kScratchSize - 1];
+    };
+}
+
+TEST_CASE("Vector growth", "[!benchmark]") {
+    BENCHMARK("std::vector<UniquePtr<int>> x 10M") {
+        std::vector<UniquePtr<int>> v;
+        for (size_t i = 0; i < kGrowthCount; ++i) {
+            v.emplace_back();
+        }
+        Catch::Benchmark::keep_memory(v.data());
+        return v.size();
+    };
+
+    BENCHMARK("RelocatingVector<UniquePtr<int>> x 10M") {
+        RelocatingVector<UniquePtr<int>> v;
+        for (size_t i = 0; i < kGrowthCount; ++i) {
+            v.EmplaceBack();
+        }
+        Catch::Benchmark::keep_memory(v.begin());
+        return v.Size();
+    };
+}
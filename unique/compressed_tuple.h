@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+template <typename... Ts>
+class CompressedTuple;
+
+template <>
+class CompressedTuple<> {};
+
+// Every element is a [[no_unique_address]] member, so empty elements take no space, including
+// final classes and repeated empty types (they only need distinct addresses, which they get
+// inside the bytes of their neighbours). Nothing is user-provided besides the constructors,
+// so the tuple is constexpr and trivially copyable whenever its elements are.
+template <typename T, typename... Rest>
+class CompressedTuple<T, Rest...> {
+public:
+    constexpr CompressedTuple() : head_(), tail_() {
+    }
+
+    template <typename U, typename... Us,
+              typename = std::enable_if_t<sizeof...(Us) == sizeof...(Rest) &&
+                                          !std::is_same_v<std::remove_cvref_t<U>, CompressedTuple>>>
+    constexpr CompressedTuple(U&& head, Us&&... tail)
+        : head_(std::forward<U>(head)), tail_(std::forward<Us>(tail)...) {
+    }
+
+    template <size_t I>
+    constexpr auto& Get() {
+        if constexpr (I == 0) {
+            return head_;
+        } else {
+            return tail_.template Get<I - 1>();
+        }
+    }
+
+    template <size_t I>
+    constexpr const auto& Get() const {
+        if constexpr (I == 0) {
+            return head_;
+        } else {
+            return tail_.template Get<I - 1>();
+        }
+    }
+
+private:
+    [[no_unique_address]] T head_;
+    [[no_unique_address]] CompressedTuple<Rest...> tail_;
+};
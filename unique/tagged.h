@@ -0,0 +1,144 @@
+#pragma once
+
+#include "unique.h"
+
+#include <cassert>
+#include <cstddef>  // std::nullptr_t
+#include <cstdint>
+
+// UniquePtr that keeps a `Bits`-bit tag in the alignment bits of the pointer.
+// The tag is independent of the owned object: it survives Reset/Release and moves with the pointer.
+template <typename T, size_t Bits, typename Deleter = MyDeleter<T>>
+class TaggedUniquePtr {
+    static_assert(Bits > 0);
+    static_assert(alignof(T) >= (size_t{1} << Bits), "alignof(T) leaves too few free bits");
+
+    static constexpr uintptr_t kTagMask = (uintptr_t{1} << Bits) - 1;
+
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    explicit TaggedUniquePtr(T* ptr = nullptr, uintptr_t tag = 0)
+        : data_(Pack(ptr, tag), Deleter()) {
+    }
+
+    TaggedUniquePtr(T* ptr, uintptr_t tag, Deleter deleter)
+        : data_(Pack(ptr, tag), std::move(deleter)) {
+    }
+
+    TaggedUniquePtr(TaggedUniquePtr&& other) noexcept
+        : data_(other.data_.GetFirst(), std::move(other.GetDeleter())) {
+        other.data_.GetFirst() &= kTagMask;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // operator=-s
+
+    TaggedUniquePtr& operator=(const TaggedUniquePtr& other) = delete;
+
+    TaggedUniquePtr& operator=(TaggedUniquePtr&& other) noexcept {
+        if (this != &other) {
+            Destroy();
+            data_.GetFirst() = other.data_.GetFirst();
+            data_.GetSecond() = std::move(other.GetDeleter());
+            other.data_.GetFirst() &= kTagMask;
+        }
+        return *this;
+    }
+
+    TaggedUniquePtr& operator=(std::nullptr_t) {
+        Reset();
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    ~TaggedUniquePtr() {
+        Destroy();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    T* Release() {
+        T* tmp = Get();
+        data_.GetFirst() &= kTagMask;
+        return tmp;
+    }
+
+    void Reset(T* ptr = nullptr) {
+        T* tmp = Get();
+        data_.GetFirst() = Pack(ptr, GetTag());
+        if (tmp) {
+            data_.GetSecond()(tmp);
+        }
+    }
+
+    void Swap(TaggedUniquePtr& other) {
+        std::swap(data_.GetFirst(), other.data_.GetFirst());
+        std::swap(data_.GetSecond(), other.GetDeleter());
+    }
+
+    void SetTag(uintptr_t tag) {
+        data_.GetFirst() = Pack(Get(), tag);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    T* Get() const {
+        return reinterpret_cast<T*>(data_.GetFirst() & ~kTagMask);
+    }
+
+    uintptr_t GetTag() const {
+        return data_.GetFirst() & kTagMask;
+    }
+
+    Deleter& GetDeleter() {
+        return data_.GetSecond();
+    }
+
+    const Deleter& GetDeleter() const {
+        return data_.GetSecond();
+    }
+
+    explicit operator bool() const {
+        return Get() != nullptr;
+    }
+
+    void PrefetchTarget() const {
+        PrefetchRead(Get());
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Single-object dereference operators
+
+    std::add_lvalue_reference_t<T> operator*() const {
+        return *Get();
+    }
+
+    T* operator->() const {
+        return Get();
+    }
+
+private:
+    // A tag wider than the free bits would lose data, so it is a bug rather than truncated
+    static uintptr_t Pack(T* ptr, uintptr_t tag) {
+        assert(tag <= kTagMask);
+        return reinterpret_cast<uintptr_t>(ptr) | (tag & kTagMask);
+    }
+
+    void Destroy() {
+        if (T* ptr = Get()) {
+            data_.GetSecond()(ptr);
+        }
+    }
+
+    CompressedPair<uintptr_t, Deleter> data_;
+};
+
+template <typename T, size_t Bits, typename Deleter>
+struct IsTriviallyRelocatable<TaggedUniquePtr<T, Bits, Deleter>>
+    : IsTriviallyRelocatable<Deleter> {};
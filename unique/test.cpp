@@ -1,10 +1,18 @@
 #include "unique.h"
+#include "unique_array.h"
+#include "tagged.h"
 
 #include "deleters.h"
 
 #include <common/my_int.h>
+#include <common/relocating_vector.h>
 
 #include <catch.hpp>
+#include <cstdint>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <string>
 #include <vector>
 #include <tuple>
 
@@ -370,6 +378,47 @@ TEST_CASE("GetDeleter") {
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+struct CountingDeleter {
+    void operator()(MyInt* ptr) {
+        ++calls;
+        delete ptr;
+    }
+
+    inline static int calls = 0;
+};
+
+TEST_CASE("Empty pointers skip the deleter") {
+    CountingDeleter::calls = 0;
+
+    SECTION("Destructor, Reset and nullptr assignment") {
+        {
+            UniquePtr<MyInt, CountingDeleter> s;
+            s.Reset();
+            s = nullptr;
+        }
+        REQUIRE(CountingDeleter::calls == 0);
+    }
+
+    SECTION("Move assignment") {
+        UniquePtr<MyInt, CountingDeleter> s1;
+        UniquePtr<MyInt, CountingDeleter> s2(new MyInt(1));
+
+        s1 = std::move(s2);
+        REQUIRE(CountingDeleter::calls == 0);
+
+        s1 = std::move(s1);
+        REQUIRE(CountingDeleter::calls == 0);
+        REQUIRE(MyInt::AliveCount() == 1);
+        REQUIRE(*s1 == 1);
+
+        s1 = std::move(s2);
+        REQUIRE(CountingDeleter::calls == 1);
+        REQUIRE(MyInt::AliveCount() == 0);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 struct VoidPtrDeleter {
     void operator()(void* ptr) {
         free(ptr);
@@ -416,6 +465,236 @@ TEST_CASE("Array specialization") {
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+TEST_CASE("MakeUnique") {
+    SECTION("Single object") {
+        auto p = MakeUnique<MyInt>(42);
+        static_assert(std::is_same_v<decltype(p), UniquePtr<MyInt>>);
+
+        REQUIRE(MyInt::AliveCount() == 1);
+        REQUIRE(*p == 42);
+    }
+
+    SECTION("Array is value-initialized") {
+        auto u = MakeUnique<int[]>(1000);
+        static_assert(std::is_same_v<decltype(u), UniquePtr<int[]>>);
+
+        for (size_t i = 0; i < 1000; ++i) {
+            REQUIRE(u[i] == 0);
+        }
+    }
+
+    SECTION("Array of objects") {
+        auto u = MakeUnique<MyInt[]>(100);
+        REQUIRE(MyInt::AliveCount() == 100);
+        u.Reset();
+        REQUIRE(MyInt::AliveCount() == 0);
+    }
+
+    SECTION("For overwrite") {
+        auto p = MakeUniqueForOverwrite<int>();
+        *p = 5;
+        REQUIRE(*p == 5);
+
+        auto u = MakeUniqueForOverwrite<int[]>(5);
+        for (int i = 0; i < 5; ++i) {
+            u[i] = i;
+        }
+        for (int i = 0; i < 5; ++i) {
+            REQUIRE(u[i] == i);
+        }
+    }
+
+    SECTION("For overwrite still constructs objects") {
+        auto u = MakeUniqueForOverwrite<MyInt[]>(100);
+        REQUIRE(MyInt::AliveCount() == 100);
+        u.Reset();
+        REQUIRE(MyInt::AliveCount() == 0);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+int SumOf(std::span<const int> values) {
+    return std::accumulate(values.begin(), values.end(), 0);
+}
+
+struct alignas(64) CacheLine {
+    int value = 7;
+};
+
+}  // namespace
+
+TEST_CASE("UniqueArray") {
+    SECTION("Empty") {
+        UniqueArray<MyInt> a;
+
+        REQUIRE(!a);
+        REQUIRE(a.Empty());
+        REQUIRE(a.Size() == 0);
+        REQUIRE(a.begin() == a.end());
+        REQUIRE(MakeUniqueArray<MyInt>(0).Get() == nullptr);
+    }
+
+    SECTION("Lifetime") {
+        auto a = MakeUniqueArray<MyInt>(100);
+
+        REQUIRE(a.Size() == 100);
+        REQUIRE(MyInt::AliveCount() == 100);
+
+        a.Reset();
+
+        REQUIRE(MyInt::AliveCount() == 0);
+        REQUIRE(a.Size() == 0);
+    }
+
+    SECTION("Value-initialized") {
+        auto a = MakeUniqueArray<int>(1000);
+        for (int x : a) {
+            REQUIRE(x == 0);
+        }
+    }
+
+    SECTION("Range and span access") {
+        auto a = MakeUniqueArrayForOverwrite<int>(5);
+        std::iota(a.begin(), a.end(), 1);
+
+        REQUIRE(a[4] == 5);
+        REQUIRE(SumOf(a) == 15);
+
+        std::span<int> view = a;
+        view[0] = 10;
+        REQUIRE(a[0] == 10);
+        REQUIRE(a.Span().size() == 5);
+    }
+
+    SECTION("Move") {
+        auto a = MakeUniqueArray<MyInt>(10);
+        MyInt* p = a.Get();
+
+        UniqueArray<MyInt> b(std::move(a));
+        REQUIRE(b.Get() == p);
+        REQUIRE(b.Size() == 10);
+        REQUIRE(a.Get() == nullptr);
+        REQUIRE(a.Size() == 0);
+
+        a = MakeUniqueArray<MyInt>(5);
+        a = std::move(b);
+        REQUIRE(MyInt::AliveCount() == 10);
+        REQUIRE(a.Get() == p);
+
+        a = nullptr;
+        REQUIRE(MyInt::AliveCount() == 0);
+    }
+
+    SECTION("Over-aligned elements") {
+        auto a = MakeUniqueArray<CacheLine>(3);
+        REQUIRE(reinterpret_cast<uintptr_t>(a.Get()) % 64 == 0);
+        REQUIRE(a[2].value == 7);
+    }
+
+    SECTION("Size overflow") {
+        REQUIRE_THROWS_AS(MakeUniqueArrayForOverwrite<long>((size_t{1} << 61) + 1),
+                          std::bad_array_new_length);
+        REQUIRE_THROWS_AS(MakeUniqueArray<MyInt>(SIZE_MAX), std::bad_array_new_length);
+        REQUIRE(MyInt::AliveCount() == 0);
+    }
+
+    SECTION("Prefetch") {
+        std::vector<UniqueArray<int>> arrays;
+        for (size_t i = 0; i < 20; ++i) {
+            arrays.push_back(MakeUniqueArray<int>(i));
+        }
+        size_t total = 0;
+        ForEachPtr(arrays, [&](const UniqueArray<int>& array) { total += array.Size(); });
+        REQUIRE(total == 190);
+        UniqueArray<int>().PrefetchTarget();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("TaggedUniquePtr") {
+    struct alignas(8) Node {
+        int value = 0;
+    };
+
+    SECTION("Sizeof") {
+        static_assert(sizeof(TaggedUniquePtr<Node, 3>) == sizeof(Node*));
+        static_assert(sizeof(TaggedUniquePtr<int, 2>) == sizeof(int*));
+    }
+
+    SECTION("Tag does not leak into the pointer") {
+        Node* raw = new Node{5};
+        TaggedUniquePtr<Node, 3> p(raw, 6);
+
+        REQUIRE(p.Get() == raw);
+        REQUIRE(p.GetTag() == 6);
+        REQUIRE(p->value == 5);
+
+        p.SetTag(1);
+        REQUIRE(p.GetTag() == 1);
+        REQUIRE(p.Get() == raw);
+        REQUIRE((*p).value == 5);
+    }
+
+    SECTION("Tag survives Reset and Release") {
+        TaggedUniquePtr<MyInt, 2> p(new MyInt(1), 3);
+        p.Reset(new MyInt(2));
+        REQUIRE(MyInt::AliveCount() == 1);
+        REQUIRE(p.GetTag() == 3);
+        REQUIRE(*p == 2);
+
+        MyInt* released = p.Release();
+        REQUIRE(!p);
+        REQUIRE(p.GetTag() == 3);
+        delete released;
+
+        p.SetTag(1);
+        REQUIRE(p.Get() == nullptr);
+    }
+
+    SECTION("Move carries the tag") {
+        TaggedUniquePtr<MyInt, 2> a(new MyInt(1), 2);
+        MyInt* raw = a.Get();
+        TaggedUniquePtr<MyInt, 2> b(std::move(a));
+
+        REQUIRE(b.Get() == raw);
+        REQUIRE(b.GetTag() == 2);
+        REQUIRE(!a);
+
+        TaggedUniquePtr<MyInt, 2> c(new MyInt(3), 1);
+        c = std::move(b);
+        REQUIRE(MyInt::AliveCount() == 1);
+        REQUIRE(c.Get() == raw);
+        REQUIRE(c.GetTag() == 2);
+
+        c = nullptr;
+        REQUIRE(MyInt::AliveCount() == 0);
+        REQUIRE(c.GetTag() == 2);
+    }
+
+    SECTION("Custom deleter") {
+        TaggedUniquePtr<MyInt, 2, Deleter<MyInt>> p(new MyInt, 1, Deleter<MyInt>(7));
+        REQUIRE(p.GetDeleter().GetTag() == 7);
+        p.Reset();
+        REQUIRE(MyInt::AliveCount() == 0);
+    }
+
+    SECTION("Prefetch") {
+        std::vector<TaggedUniquePtr<Node, 3>> nodes;
+        for (int i = 0; i < 20; ++i) {
+            nodes.emplace_back(i % 5 == 0 ? nullptr : new Node{i}, i % 8);
+        }
+        int sum = 0;
+        ForEachDeref(nodes, [&](const Node& node) { sum += node.value; });
+        REQUIRE(sum == 190 - 30);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 template <typename T>
 void DeleteFunction(T* ptr) {
     delete ptr;
@@ -466,6 +745,224 @@ TEST_CASE("Compressed pair usage") {
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+struct Empty {};
+
+struct FinalEmpty final {};
+
+struct FinalDeleter final {
+    void operator()(int* ptr) const {
+        delete ptr;
+    }
+};
+
+TEST_CASE("Compressed tuple") {
+    SECTION("Empty elements take no space") {
+        static_assert(sizeof(CompressedTuple<int*, Empty>) == sizeof(int*));
+        static_assert(sizeof(CompressedTuple<int*, FinalEmpty>) == sizeof(int*));
+        static_assert(sizeof(CompressedTuple<int*, Empty, Empty>) == sizeof(int*));
+        static_assert(sizeof(CompressedTuple<int*, Empty, FinalEmpty, Empty>) == sizeof(int*));
+        static_assert(sizeof(CompressedPair<Empty, Empty>) == 2);
+        static_assert(sizeof(UniquePtr<int, FinalDeleter>) == sizeof(int*));
+    }
+
+    SECTION("Triviality is kept") {
+        static_assert(std::is_trivially_copyable_v<CompressedTuple<int*, Empty, int>>);
+        static_assert(std::is_trivially_copyable_v<CompressedPair<int*, Empty>>);
+        static_assert(!std::is_trivially_copyable_v<CompressedTuple<int*, std::vector<int>>>);
+    }
+
+    SECTION("constexpr") {
+        constexpr CompressedTuple<int, Empty, long> t(1, Empty{}, 2L);
+        static_assert(t.Get<0>() == 1);
+        static_assert(t.Get<2>() == 2);
+
+        constexpr CompressedPair<int, char> p(3, 'x');
+        static_assert(p.GetFirst() == 3 && p.GetSecond() == 'x');
+    }
+
+    SECTION("Access") {
+        CompressedTuple<int, std::vector<int>, Empty> t(1, std::vector<int>{1, 2}, Empty{});
+        t.Get<0>() = 5;
+        t.Get<1>().push_back(3);
+        REQUIRE(t.Get<0>() == 5);
+        REQUIRE(t.Get<1>() == std::vector<int>{1, 2, 3});
+
+        CompressedTuple<int*, Empty> d;
+        REQUIRE(d.Get<0>() == nullptr);
+    }
+
+    SECTION("Same empty types in a pair are distinct objects") {
+        CompressedPair<Empty, Empty> p;
+        REQUIRE(static_cast<void*>(&p.GetFirst()) != static_cast<void*>(&p.GetSecond()));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct PlainBase {
+    int id = 0;
+};
+
+struct Extra {
+    std::string name = "extra";
+};
+
+struct PlainDerived : Extra, PlainBase {
+    PlainDerived() = default;
+
+    explicit PlainDerived(int id) {
+        this->id = id;
+    }
+
+    ~PlainDerived() {
+        ++destroyed;
+    }
+
+    MyInt payload;
+    inline static int destroyed = 0;
+};
+
+TEST_CASE("ErasedDelete") {
+    PlainDerived::destroyed = 0;
+
+    SECTION("Layout") {
+        static_assert(!std::has_virtual_destructor_v<PlainBase>);
+        static_assert(sizeof(UniquePtr<PlainBase, ErasedDelete<PlainBase>>) == 2 * sizeof(void*));
+        static_assert(sizeof(UniquePtr<PlainBase>) == sizeof(void*));
+    }
+
+    SECTION("MakeUniqueErased") {
+        auto p = MakeUniqueErased<PlainBase, PlainDerived>(7);
+        REQUIRE(p->id == 7);
+        REQUIRE(MyInt::AliveCount() == 1);
+
+        p.Reset();
+        REQUIRE(PlainDerived::destroyed == 1);
+        REQUIRE(MyInt::AliveCount() == 0);
+    }
+
+    SECTION("Conversion from UniquePtr<Derived>") {
+        UniquePtr<PlainBase, ErasedDelete<PlainBase>> p = MakeUnique<PlainDerived>(3);
+        UniquePtr<PlainBase, ErasedDelete<PlainBase>> q(new PlainBase{4});
+        REQUIRE(MyInt::AliveCount() == 1);
+
+        q = std::move(p);
+        REQUIRE(q->id == 3);
+        REQUIRE(PlainDerived::destroyed == 0);
+
+        q = nullptr;
+        REQUIRE(PlainDerived::destroyed == 1);
+        REQUIRE(MyInt::AliveCount() == 0);
+    }
+
+    SECTION("void owner") {
+        static_assert(!std::is_default_constructible_v<ErasedDelete<void>>);
+        static_assert(std::is_default_constructible_v<ErasedDelete<PlainBase>>);
+        {
+            UniquePtr<void, ErasedDelete<void>> p = MakeUnique<PlainDerived>();
+            REQUIRE(MyInt::AliveCount() == 1);
+        }
+        REQUIRE(PlainDerived::destroyed == 1);
+        REQUIRE(MyInt::AliveCount() == 0);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Trivial relocation") {
+    SECTION("Trait") {
+        static_assert(kIsTriviallyRelocatable<UniquePtr<MyInt>>);
+        static_assert(kIsTriviallyRelocatable<UniquePtr<MyInt[]>>);
+        static_assert(kIsTriviallyRelocatable<UniquePtr<int, StatefulDeleter<int>>>);
+        static_assert(!kIsTriviallyRelocatable<UniquePtr<MyInt, Deleter<MyInt>>>);
+        static_assert(kIsTriviallyRelocatable<UniqueArray<MyInt>>);
+        static_assert(kIsTriviallyRelocatable<TaggedUniquePtr<int, 2>>);
+        static_assert(!kIsTriviallyRelocatable<std::string>);
+    }
+
+    SECTION("Growth keeps the objects") {
+        RelocatingVector<UniquePtr<MyInt>> v;
+        std::vector<MyInt*> raw;
+        for (int i = 0; i < 1000; ++i) {
+            v.PushBack(MakeUnique<MyInt>(i));
+            raw.push_back(v[i].Get());
+        }
+
+        REQUIRE(v.Size() == 1000);
+        REQUIRE(MyInt::AliveCount() == 1000);
+        for (int i = 0; i < 1000; ++i) {
+            REQUIRE(v[i].Get() == raw[i]);
+            REQUIRE(*v[i] == i);
+        }
+
+        v.Clear();
+        REQUIRE(MyInt::AliveCount() == 0);
+    }
+
+    SECTION("Erase") {
+        RelocatingVector<UniquePtr<MyInt>> v;
+        for (int i = 0; i < 10; ++i) {
+            v.EmplaceBack(new MyInt(i));
+        }
+
+        v.Erase(0);
+        v.Erase(2, 5);
+        v.PopBack();
+
+        REQUIRE(MyInt::AliveCount() == 5);
+        std::vector<int> expected{1, 2, 6, 7, 8};
+        REQUIRE(v.Size() == expected.size());
+        for (size_t i = 0; i < v.Size(); ++i) {
+            REQUIRE(*v[i] == expected[i]);
+        }
+    }
+
+    SECTION("Non-relocatable elements") {
+        RelocatingVector<std::string> v;
+        for (int i = 0; i < 100; ++i) {
+            v.PushBack(std::to_string(i));
+        }
+        v.Erase(10, 90);
+
+        REQUIRE(v.Size() == 20);
+        REQUIRE(v[9] == "9");
+        REQUIRE(v[10] == "90");
+
+        RelocatingVector<std::string> moved(std::move(v));
+        REQUIRE(v.Empty());
+        REQUIRE(moved[19] == "99");
+    }
+
+    SECTION("Pushing an element of the same vector") {
+        RelocatingVector<std::string> strings;
+        strings.PushBack(std::string(100, 'x'));
+        for (int i = 0; i < 10; ++i) {
+            strings.PushBack(strings[0]);
+        }
+        for (const std::string& string : strings) {
+            REQUIRE(string == std::string(100, 'x'));
+        }
+
+        RelocatingVector<int> ints;
+        ints.PushBack(42);
+        for (int i = 0; i < 10; ++i) {
+            ints.EmplaceBack(ints[ints.Size() - 1]);
+        }
+        for (int value : ints) {
+            REQUIRE(value == 42);
+        }
+    }
+
+    SECTION("Capacity overflow") {
+        RelocatingVector<int> v;
+        REQUIRE_THROWS_AS(v.Reserve(RelocatingVector<int>::MaxSize() + 1), std::length_error);
+        REQUIRE_THROWS_AS(v.Reserve(SIZE_MAX), std::length_error);
+        REQUIRE(v.Capacity() == 0);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 template <typename T>
 class DerivedDeleter : public Deleter<T> {};
 
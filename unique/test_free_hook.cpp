@@ -0,0 +1,91 @@
+// Built with -DSMART_PTR_FREE=CountingFree (see CMakeLists.txt): every free goes through the hook
+// with the static size and alignment of what was allocated.
+
+#include <cstddef>
+#include <new>
+
+namespace {
+
+struct FreeRecord {
+    size_t calls = 0;
+    size_t size = 0;
+    size_t alignment = 0;
+};
+
+FreeRecord last_free;
+
+}  // namespace
+
+void CountingFree(void* ptr, size_t size, size_t alignment) {
+    ++last_free.calls;
+    last_free.size = size;
+    last_free.alignment = alignment;
+    if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        ::operator delete(ptr, size, std::align_val_t{alignment});
+    } else {
+        ::operator delete(ptr, size);
+    }
+}
+
+#include "unique.h"
+#include "unique_array.h"
+
+#include <shared/shared.h>
+
+#include <catch.hpp>
+
+namespace {
+
+struct alignas(64) Padded {
+    char bytes[100];
+};
+
+struct Polymorphic {
+    virtual ~Polymorphic() = default;
+    int value = 0;
+};
+
+struct FinalPolymorphic final : Polymorphic {};
+
+}  // namespace
+
+TEST_CASE("Frees reach SMART_PTR_FREE") {
+    last_free = {};
+
+    SECTION("Ordinary types") {
+        UniquePtr<long>(new long(1)).Reset();
+        REQUIRE(last_free.calls == 1);
+        REQUIRE(last_free.size == sizeof(long));
+        REQUIRE(last_free.alignment == alignof(long));
+    }
+
+    SECTION("Over-aligned types") {
+        UniquePtr<Padded>(new Padded).Reset();
+        REQUIRE(last_free.calls == 1);
+        REQUIRE(last_free.size == sizeof(Padded));
+        REQUIRE(last_free.alignment == 64);
+
+        MakeUniqueArray<Padded>(3).Reset();
+        REQUIRE(last_free.calls == 2);
+        REQUIRE(last_free.size == 3 * sizeof(Padded));
+        REQUIRE(last_free.alignment == 64);
+    }
+
+    SECTION("Control blocks") {
+        MakeShared<Padded>().Reset();
+        REQUIRE(last_free.calls == 1);
+        REQUIRE(last_free.size >= sizeof(Padded));
+        REQUIRE(last_free.alignment == 64);
+    }
+
+    SECTION("Final polymorphic types") {
+        UniquePtr<FinalPolymorphic>(new FinalPolymorphic).Reset();
+        REQUIRE(last_free.calls == 1);
+        REQUIRE(last_free.size == sizeof(FinalPolymorphic));
+    }
+
+    SECTION("Polymorphic types that are not final bypass the hook") {
+        UniquePtr<Polymorphic>(new Polymorphic).Reset();
+        REQUIRE(last_free.calls == 0);
+    }
+}
@@ -2,7 +2,13 @@
 
 #include "compressed_pair.h"
 
+#include <common/allocation.h>
+#include <common/prefetch.h>
+#include <common/relocation.h>
+
 #include <cstddef>  // std::nullptr_t
+#include <type_traits>
+#include <utility>  // std::exchange
 
 struct Slug {};
 
@@ -22,7 +28,7 @@ public:
     void operator()(T* ptr) {
         static_assert(sizeof(T) > 0);
         static_assert(!std::is_void_v<T>);
-        delete ptr;
+        DeleteObject(ptr);
     }
 };
 
@@ -36,6 +42,35 @@ public:
     }
 };
 
+// Deleter that captures the destroy function of the concrete type at construction, the way
+// SharedPtr's PtrBlock<Y> does. `UniquePtr<Base, ErasedDelete<Base>>` may then own a Derived
+// even if Base has no virtual destructor, at the cost of one function pointer.
+// Base must be a non-virtual base of the concrete type (or void). `ErasedDelete<void>` knows no
+// type to destroy, so it can only be made from the deleter of a typed UniquePtr.
+template <typename T>
+class ErasedDelete {
+public:
+    ErasedDelete() requires(!std::is_void_v<T>) : destroy_(&Destroy<T>) {
+    }
+
+    // Adopts an object created as `U`, e.g. when converting from UniquePtr<U>
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+    ErasedDelete(const MyDeleter<U>&) : destroy_(&Destroy<U>) {
+    }
+
+    void operator()(T* ptr) const {
+        destroy_(ptr);
+    }
+
+private:
+    template <typename U>
+    static void Destroy(T* ptr) {
+        DeleteObject(static_cast<U*>(ptr));
+    }
+
+    void (*destroy_)(T*);
+};
+
 // Primary template
 template <typename T, typename Deleter = MyDeleter<T>>
 class UniquePtr {
@@ -64,27 +99,26 @@ public:
 
     UniquePtr& operator=(const UniquePtr& other) = delete;
 
+    // Self-move is harmless: `other` is emptied before the old pointer is released
     UniquePtr& operator=(UniquePtr&& other) noexcept {
-        if (this != &other) {
-            data_.GetSecond()(data_.GetFirst());
-            data_.GetFirst() = other.data_.GetFirst();
-            data_.GetSecond() = std::move(other.GetDeleter());
-            other.data_.GetFirst() = nullptr;
-        }
+        Reset(other.Release());
+        data_.GetSecond() = std::move(other.GetDeleter());
         return *this;
     }
 
     UniquePtr& operator=(std::nullptr_t) {
-        data_.GetSecond()(data_.GetFirst());
-        data_.GetFirst() = nullptr;
+        Reset();
         return *this;
     }
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Destructor
 
+    // The deleter is never called for nullptr, so an empty UniquePtr costs nothing to destroy
     ~UniquePtr() {
-        data_.GetSecond()(data_.GetFirst());
+        if (T* ptr = data_.GetFirst()) {
+            data_.GetSecond()(ptr);
+        }
     }
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -97,9 +131,9 @@ public:
     }
 
     void Reset(T* ptr = nullptr) {
-        auto tmp = data_.GetFirst();
-        data_.GetFirst() = ptr;
-        data_.GetSecond()(tmp);
+        if (T* old = std::exchange(data_.GetFirst(), ptr)) {
+            data_.GetSecond()(old);
+        }
     }
 
     void Swap(UniquePtr& other) {
@@ -123,10 +157,11 @@ public:
     }
 
     explicit operator bool() const {
-        if (data_.GetFirst() != nullptr) {
-            return true;
-        }
-        return false;
+        return data_.GetFirst() != nullptr;
+    }
+
+    void PrefetchTarget() const {
+        PrefetchRead(data_.GetFirst());
     }
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -167,27 +202,26 @@ public:
 
     UniquePtr& operator=(const UniquePtr& other) = delete;
 
+    // Self-move is harmless: `other` is emptied before the old pointer is released
     UniquePtr& operator=(UniquePtr&& other) noexcept {
-        if (this != &other) {
-            data_.GetSecond()(data_.GetFirst());
-            data_.GetFirst() = other.data_.GetFirst();
-            data_.GetSecond() = std::move(other.GetDeleter());
-            other.data_.GetFirst() = nullptr;
-        }
+        Reset(other.Release());
+        data_.GetSecond() = std::move(other.GetDeleter());
         return *this;
     }
 
     UniquePtr& operator=(std::nullptr_t) {
-        data_.GetSecond()(data_.GetFirst());
-        data_.GetFirst() = nullptr;
+        Reset();
         return *this;
     }
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Destructor
 
+    // The deleter is never called for nullptr, so an empty UniquePtr costs nothing to destroy
     ~UniquePtr() {
-        data_.GetSecond()(data_.GetFirst());
+        if (T* ptr = data_.GetFirst()) {
+            data_.GetSecond()(ptr);
+        }
     }
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -200,9 +234,9 @@ public:
     }
 
     void Reset(T* ptr = nullptr) {
-        auto tmp = data_.GetFirst();
-        data_.GetFirst() = ptr;
-        data_.GetSecond()(tmp);
+        if (T* old = std::exchange(data_.GetFirst(), ptr)) {
+            data_.GetSecond()(old);
+        }
     }
 
     void Swap(UniquePtr& other) {
@@ -226,10 +260,11 @@ public:
     }
 
     explicit operator bool() const {
-        if (data_.GetFirst() != nullptr) {
-            return true;
-        }
-        return false;
+        return data_.GetFirst() != nullptr;
+    }
+
+    void PrefetchTarget() const {
+        PrefetchRead(data_.GetFirst());
     }
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -246,3 +281,41 @@ public:
 private:
     CompressedPair<T*, Deleter> data_;
 };
+
+// Relocating a UniquePtr moves the pointer bits; it only depends on the deleter
+template <typename T, typename Deleter>
+struct IsTriviallyRelocatable<UniquePtr<T, Deleter>> : IsTriviallyRelocatable<Deleter> {};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Factories
+
+template <typename T, typename... Args>
+std::enable_if_t<!std::is_array_v<T>, UniquePtr<T>> MakeUnique(Args&&... args) {
+    return UniquePtr<T>(new T(std::forward<Args>(args)...));
+}
+
+// Value-initializes the elements, so arrays of scalars come back zeroed
+template <typename T>
+std::enable_if_t<std::is_unbounded_array_v<T>, UniquePtr<T>> MakeUnique(size_t size) {
+    return UniquePtr<T>(new std::remove_extent_t<T>[size]());
+}
+
+template <typename T>
+std::enable_if_t<!std::is_array_v<T>, UniquePtr<T>> MakeUniqueForOverwrite() {
+    return UniquePtr<T>(new T);
+}
+
+// Default-initializes the elements: trivial types are left as is, so a large buffer
+// is neither memset nor faulted in until the caller writes to it
+template <typename T>
+std::enable_if_t<std::is_unbounded_array_v<T>, UniquePtr<T>> MakeUniqueForOverwrite(size_t size) {
+    return UniquePtr<T>(new std::remove_extent_t<T>[size]);
+}
+
+// Creates a `Derived` owned through `Base`; the object is destroyed as a `Derived`
+template <typename Base, typename Derived, typename... Args>
+UniquePtr<Base, ErasedDelete<Base>> MakeUniqueErased(Args&&... args) {
+    static_assert(std::is_convertible_v<Derived*, Base*>);
+    return UniquePtr<Base, ErasedDelete<Base>>(new Derived(std::forward<Args>(args)...),
+                                               ErasedDelete<Base>(MyDeleter<Derived>()));
+}
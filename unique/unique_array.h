@@ -0,0 +1,201 @@
+#pragma once
+
+#include <common/allocation.h>
+#include <common/prefetch.h>
+#include <common/relocation.h>
+
+#include <cstddef>  // std::nullptr_t
+#include <cstdint>  // SIZE_MAX
+#include <memory>   // std::uninitialized_*_construct_n / std::destroy_n
+#include <new>      // std::bad_array_new_length
+#include <span>
+#include <utility>
+
+// Owning array that remembers its length.
+// Storage is obtained and released by the class itself, which lets it free with a sized
+// deallocation (no array cookie, no size lookup in the allocator).
+template <typename T>
+class UniqueArray {
+    template <typename U>
+    friend UniqueArray<U> MakeUniqueArray(size_t size);
+
+    template <typename U>
+    friend UniqueArray<U> MakeUniqueArrayForOverwrite(size_t size);
+
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    UniqueArray() : data_(nullptr), size_(0) {
+    }
+
+    UniqueArray(std::nullptr_t) : data_(nullptr), size_(0) {
+    }
+
+    UniqueArray(UniqueArray&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // operator=-s
+
+    UniqueArray& operator=(const UniqueArray& other) = delete;
+
+    UniqueArray& operator=(UniqueArray&& other) noexcept {
+        if (this != &other) {
+            Reset();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+        }
+        return *this;
+    }
+
+    UniqueArray& operator=(std::nullptr_t) {
+        Reset();
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    ~UniqueArray() {
+        Reset();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    void Reset() {
+        if (data_) {
+            std::destroy_n(data_, size_);
+            Deallocate(data_, size_);
+            data_ = nullptr;
+            size_ = 0;
+        }
+    }
+
+    void Swap(UniqueArray& other) {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    T* Get() const {
+        return data_;
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+    bool Empty() const {
+        return size_ == 0;
+    }
+
+    explicit operator bool() const {
+        return data_ != nullptr;
+    }
+
+    void PrefetchTarget() const {
+        PrefetchRead(data_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Element access
+
+    T& operator[](size_t index) {
+        return data_[index];
+    }
+
+    const T& operator[](size_t index) const {
+        return data_[index];
+    }
+
+    T* begin() {
+        return data_;
+    }
+
+    T* end() {
+        return data_ + size_;
+    }
+
+    const T* begin() const {
+        return data_;
+    }
+
+    const T* end() const {
+        return data_ + size_;
+    }
+
+    std::span<T> Span() {
+        return {data_, size_};
+    }
+
+    std::span<const T> Span() const {
+        return {data_, size_};
+    }
+
+    operator std::span<T>() {
+        return Span();
+    }
+
+    operator std::span<const T>() const {
+        return Span();
+    }
+
+private:
+    // Throws std::bad_array_new_length when the byte size overflows, like `new T[size]`
+    static T* Allocate(size_t size) {
+        if (size > SIZE_MAX / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        return static_cast<T*>(::Allocate(size * sizeof(T), alignof(T)));
+    }
+
+    static void Deallocate(T* data, size_t size) {
+        ::Deallocate(data, size * sizeof(T), alignof(T));
+    }
+
+    // Takes ownership of storage for `size` elements; the elements are constructed by `init`.
+    template <typename Init>
+    static UniqueArray Create(size_t size, Init init) {
+        UniqueArray result;
+        if (size == 0) {
+            return result;
+        }
+        T* data = Allocate(size);
+        try {
+            init(data, size);
+        } catch (...) {
+            Deallocate(data, size);
+            throw;
+        }
+        result.data_ = data;
+        result.size_ = size;
+        return result;
+    }
+
+    T* data_;
+    size_t size_;
+};
+
+// Value-initializes the elements
+template <typename T>
+UniqueArray<T> MakeUniqueArray(size_t size) {
+    return UniqueArray<T>::Create(size, [](T* data, size_t n) {
+        std::uninitialized_value_construct_n(data, n);
+    });
+}
+
+// Default-initializes the elements: trivial types are left untouched
+template <typename T>
+UniqueArray<T> MakeUniqueArrayForOverwrite(size_t size) {
+    return UniqueArray<T>::Create(size, [](T* data, size_t n) {
+        std::uninitialized_default_construct_n(data, n);
+    });
+}
+
+template <typename T>
+struct IsTriviallyRelocatable<UniqueArray<T>> : std::true_type {};
@@ -0,0 +1,265 @@
+#pragma once
+
+#include "shared.h"
+#include "weak.h"
+
+#include <cassert>
+#include <cstddef>  // std::nullptr_t
+#include <type_traits>
+#include <utility>
+
+// Single-word handles for objects created by `MakeShared`.
+// Only the control block is stored: the object lives at a fixed offset inside its ValueBlock,
+// so aliasing and objects adopted from raw pointers are not supported.
+// Conversions to and from SharedPtr/WeakPtr hand the reference over without touching the counts.
+
+template <typename T>
+class CompactWeakPtr;
+
+template <typename T>
+class CompactSharedPtr {
+    template <typename Y>
+    friend class CompactWeakPtr;
+
+    using Block = ValueBlock<std::remove_cv_t<T>>;
+
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    CompactSharedPtr() : block_(nullptr) {
+    }
+
+    CompactSharedPtr(std::nullptr_t) : block_(nullptr) {
+    }
+
+    // `other` must own the whole object of a `MakeShared<T>` call
+    explicit CompactSharedPtr(SharedPtr<T>&& other) : block_(FromBlock(other.GetBlock())) {
+        assert(Get() == other.GetPtr());
+        other.SetBlock(nullptr);
+        other.SetPtr(nullptr);
+    }
+
+    CompactSharedPtr(const CompactSharedPtr& other) : block_(other.block_) {
+        if (block_) {
+            block_->StrongInc();
+        }
+    }
+
+    CompactSharedPtr(CompactSharedPtr&& other) : block_(std::exchange(other.block_, nullptr)) {
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+
+    CompactSharedPtr& operator=(const CompactSharedPtr& other) {
+        CompactSharedPtr(other).Swap(*this);
+        return *this;
+    }
+
+    CompactSharedPtr& operator=(CompactSharedPtr&& other) {
+        CompactSharedPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    ~CompactSharedPtr() {
+        Reset();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Conversions
+
+    // Hands the reference over to a full SharedPtr
+    SharedPtr<T> ToShared() && {
+        T* ptr = Get();
+        return SharedPtr<T>(ptr, std::exchange(block_, nullptr));
+    }
+
+    SharedPtr<T> ToShared() const& {
+        return CompactSharedPtr(*this).ToShared();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    void Reset() {
+        if (block_) {
+            // The full pointer runs the usual release sequence
+            SharedPtr<T> last(Get(), std::exchange(block_, nullptr));
+        }
+    }
+
+    void Swap(CompactSharedPtr& other) {
+        std::swap(block_, other.block_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    T* Get() const {
+        if (block_) {
+            return block_->Get();
+        }
+        return nullptr;
+    }
+
+    T& operator*() const {
+        return *Get();
+    }
+
+    T* operator->() const {
+        return Get();
+    }
+
+    size_t UseCount() const {
+        if (block_) {
+            return static_cast<size_t>(block_->GetStrongCount());
+        }
+        return 0;
+    }
+
+    explicit operator bool() const {
+        return block_ != nullptr;
+    }
+
+    // The object and the counts are in the same block
+    void PrefetchTarget() const {
+        PrefetchRead(block_);
+    }
+
+    void PrefetchCounts() const {
+        PrefetchWrite(block_);
+    }
+
+private:
+    static Block* FromBlock(BaseBlock* block) {
+        assert(!block || dynamic_cast<Block*>(block));
+        return static_cast<Block*>(block);
+    }
+
+    Block* block_;
+};
+
+template <typename T>
+class CompactWeakPtr {
+    using Block = ValueBlock<std::remove_cv_t<T>>;
+
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    CompactWeakPtr() : block_(nullptr) {
+    }
+
+    CompactWeakPtr(const CompactSharedPtr<T>& other) : block_(other.block_) {
+        if (block_) {
+            block_->WeakInc();
+        }
+    }
+
+    // `other` must track the whole object of a `MakeShared<T>` call
+    explicit CompactWeakPtr(WeakPtr<T>&& other)
+        : block_(CompactSharedPtr<T>::FromBlock(other.GetBlock())) {
+        assert(!block_ || block_->Get() == other.GetPtr());
+        other.MakeNull();
+    }
+
+    CompactWeakPtr(const CompactWeakPtr& other) : block_(other.block_) {
+        if (block_) {
+            block_->WeakInc();
+        }
+    }
+
+    CompactWeakPtr(CompactWeakPtr&& other) : block_(std::exchange(other.block_, nullptr)) {
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+
+    CompactWeakPtr& operator=(const CompactWeakPtr& other) {
+        CompactWeakPtr(other).Swap(*this);
+        return *this;
+    }
+
+    CompactWeakPtr& operator=(CompactWeakPtr&& other) {
+        CompactWeakPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    ~CompactWeakPtr() {
+        Reset();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Conversions
+
+    // Hands the weak reference over to a full WeakPtr
+    WeakPtr<T> ToWeak() && {
+        WeakPtr<T> result;
+        if (block_) {
+            result.SetPtr(block_->Get());
+            result.SetBlock(std::exchange(block_, nullptr));
+        }
+        return result;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    void Reset() {
+        if (block_) {
+            std::exchange(block_, nullptr)->WeakRelease();
+        }
+    }
+
+    void Swap(CompactWeakPtr& other) {
+        std::swap(block_, other.block_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    size_t UseCount() const {
+        if (block_) {
+            return static_cast<size_t>(block_->GetStrongCount());
+        }
+        return 0;
+    }
+
+    bool Expired() const {
+        return !block_ || block_->GetStrongCount() == 0;
+    }
+
+    // The counts `Lock` looks at
+    void PrefetchTarget() const {
+        PrefetchRead(block_);
+    }
+
+    CompactSharedPtr<T> Lock() const {
+        CompactSharedPtr<T> result;
+        if (block_ && block_->StrongIncIfNonZero()) {
+            result.block_ = block_;
+        }
+        return result;
+    }
+
+private:
+    Block* block_;
+};
+
+template <typename T>
+struct IsTriviallyRelocatable<CompactSharedPtr<T>> : std::true_type {};
+
+template <typename T>
+struct IsTriviallyRelocatable<CompactWeakPtr<T>> : std::true_type {};
+
+template <typename T, typename... Args>
+CompactSharedPtr<T> MakeCompactShared(Args&&... args) {
+    return CompactSharedPtr<T>(MakeShared<T>(std::forward<Args>(args)...));
+}
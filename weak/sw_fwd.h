@@ -1,11 +1,12 @@
 #pragma once
 
-#include <exception>
+#include <common/shared_fwd.h>
 
-class BadWeakPtr : public std::exception {};
+// Strong and weak references, not thread-safe
+using SharedConfig = SharedPolicy<PlainCount, WithWeak, NoSharedFromThis, DefaultAllocation>;
 
 template <typename T>
-class SharedPtr;
+using SharedPtr = BasicSharedPtr<T, SharedConfig>;
 
 template <typename T>
-class WeakPtr;
+using WeakPtr = BasicWeakPtr<T, SharedConfig>;
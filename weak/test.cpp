@@ -1,5 +1,6 @@
 #include "shared.h"
 #include "weak.h"
+#include "compact.h"
 
 #include <common/my_int.h>
 
@@ -175,3 +176,127 @@ TEST_CASE("Lifetimes") {
         delete wp;
     }
 }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Compact pointers") {
+    SECTION("Sizeof") {
+        static_assert(sizeof(CompactSharedPtr<std::string>) == sizeof(void*));
+        static_assert(sizeof(CompactWeakPtr<std::string>) == sizeof(void*));
+    }
+
+    SECTION("Lifetime") {
+        {
+            auto a = MakeCompactShared<MyInt>(42);
+            auto b = a;
+            CompactSharedPtr<MyInt> c;
+            c = std::move(b);
+
+            REQUIRE(MyInt::AliveCount() == 1);
+            REQUIRE(a.UseCount() == 2);
+            REQUIRE(*c == 42);
+            REQUIRE(!b);
+        }
+        REQUIRE(MyInt::AliveCount() == 0);
+    }
+
+    SECTION("Round trip does not touch counts") {
+        auto sp = MakeShared<std::string>("compact");
+        auto copy = sp;
+        std::string* p = sp.Get();
+
+        CompactSharedPtr<std::string> compact(std::move(sp));
+        REQUIRE(!sp);
+        REQUIRE(compact.Get() == p);
+        REQUIRE(compact->size() == 7);
+        REQUIRE(compact.UseCount() == 2);
+
+        SharedPtr<std::string> back = std::move(compact).ToShared();
+        REQUIRE(!compact);
+        REQUIRE(back.Get() == p);
+        REQUIRE(back.UseCount() == 2);
+        REQUIRE(back.GetBlock() == copy.GetBlock());
+    }
+
+    SECTION("Const") {
+        SharedPtr<const int> sp = MakeShared<int>(5);
+        CompactSharedPtr<const int> compact(std::move(sp));
+        REQUIRE(*compact == 5);
+    }
+
+    SECTION("Weak") {
+        CompactWeakPtr<MyInt> weak;
+        REQUIRE(weak.Expired());
+        REQUIRE(!weak.Lock());
+        {
+            auto a = MakeCompactShared<MyInt>(1);
+            weak = a;
+            REQUIRE(!weak.Expired());
+            REQUIRE(weak.UseCount() == 1);
+
+            auto locked = weak.Lock();
+            REQUIRE(locked.Get() == a.Get());
+            REQUIRE(a.UseCount() == 2);
+        }
+        REQUIRE(MyInt::AliveCount() == 0);
+        REQUIRE(weak.Expired());
+        REQUIRE(!weak.Lock());
+    }
+
+    SECTION("Weak round trip") {
+        auto a = MakeCompactShared<int>(7);
+        WeakPtr<int> full = CompactWeakPtr<int>(a).ToWeak();
+        REQUIRE(full.Lock().Get() == a.Get());
+
+        CompactWeakPtr<int> weak(std::move(full));
+        REQUIRE(full.Expired());
+        REQUIRE(*weak.Lock() == 7);
+
+        a.Reset();
+        REQUIRE(weak.Expired());
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Trivial relocation") {
+    static_assert(kIsTriviallyRelocatable<SharedPtr<std::string>>);
+    static_assert(kIsTriviallyRelocatable<WeakPtr<std::string>>);
+    static_assert(kIsTriviallyRelocatable<CompactSharedPtr<std::string>>);
+    static_assert(kIsTriviallyRelocatable<CompactWeakPtr<std::string>>);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Parent;
+
+struct Child {
+    void Traverse(GcVisitor& visitor) {
+        visitor.Visit(parent);
+    }
+
+    SharedPtr<Parent> parent;
+};
+
+struct Parent {
+    void Traverse(GcVisitor& visitor) {
+        visitor.Visit(child);
+    }
+
+    SharedPtr<Child> child;
+};
+
+TEST_CASE("Collected cycles expire weak pointers") {
+    auto parent = MakeShared<Parent>();
+    parent->child = MakeShared<Child>();
+    parent->child->parent = parent;
+    WeakPtr<Parent> weak_parent = parent;
+    WeakPtr<Child> weak_child = parent->child;
+    parent.Reset();
+    REQUIRE(!weak_parent.Expired());
+
+    REQUIRE(CollectCycles().objects == 2);
+    REQUIRE(weak_parent.Expired());
+    REQUIRE(weak_child.Expired());
+    REQUIRE(!weak_parent.Lock());
+}